@@ -11,16 +11,22 @@ namespace FileIO
     void out(std::string, std::string);
     void err(std::string, std::string);
 
-    std::string graphcrunch_in(std::string, std::string);
-
     std::vector<std::vector<double>> file_to_matrix(std::string);
     std::vector<std::string> parse_labels(std::string);
 
     void graph_to_file(std::string, std::vector<std::string>, std::vector<std::vector<unsigned>>);
-    void gdvs_to_file(std::string, std::vector<std::string>, std::vector<std::vector<unsigned>>);
+    void gdvs_to_file(std::string, std::vector<std::string>, const GraphCrunch::GdvMatrix &);
     void matrix_to_file(std::string, std::vector<std::string>, std::vector<std::string>, std::vector<std::vector<double>>);
+    void matrix_to_file(std::string, const std::vector<std::string> &, const std::vector<std::string> &, Util::CostProvider &);
     void alignment_to_matrix_file(std::string, std::vector<std::string>, std::vector<std::string>, std::vector<std::vector<double>>, double);
     void alignment_to_list_file(std::string, std::vector<std::string>, std::vector<std::string>, std::vector<std::vector<double>>, double);
+
+    std::string gdv_cache_path(std::string, unsigned long long, unsigned);
+    bool cache_to_gdvs(std::string, unsigned long long, unsigned, unsigned, GraphCrunch::GdvMatrix &);
+    void gdvs_to_cache(std::string, unsigned long long, const GraphCrunch::GdvMatrix &);
+
+    bool file_to_warm_start(std::string, unsigned, unsigned, Util::WarmStart &);
+    void warm_start_to_file(std::string, const Util::WarmStart &);
 }
 
 #endif
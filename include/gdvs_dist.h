@@ -3,7 +3,27 @@
 
 namespace GDVs_Dist
 {
-    std::vector<std::vector<double>> gdvs_dist(std::vector<std::vector<unsigned>>, std::vector<std::vector<unsigned>>, double);
+    enum Metric
+    {
+        GRAAL,      // GRAAL's weighted log distance of the GDVs
+        COSINE,     // cosine similarity of the log GDVs
+        AGREEMENT,  // GDV agreement: GRAAL's distance without the orbit weights
+        WEIGHTED_L1 // weighted L1 distance of the log GDVs, each orbit scaled to its range
+    };
+
+    /*
+     * How the GDVs of two nodes are compared: the metric, over the given GDV columns (orbits),
+     * or over all of them if none are given.
+     */
+    struct Measure
+    {
+        Metric metric = GRAAL;
+        std::vector<unsigned> orbits;
+    };
+
+    Util::CostProvider provider(const GraphCrunch::GdvMatrix &, const GraphCrunch::GdvMatrix &, double, const Measure &, unsigned);
+    Util::SparseCostMatrix candidates(const GraphCrunch::GdvMatrix &, const GraphCrunch::GdvMatrix &, double, const Measure &,
+                                      unsigned, unsigned);
 }
 
 #endif
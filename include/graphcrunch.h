@@ -3,7 +3,58 @@
 
 namespace GraphCrunch
 {
-    std::vector<std::vector<unsigned>> graphcrunch(std::string);
+    enum Engine
+    {
+        ENUMERATE, // brute force enumeration of 3-5 node paths and claws
+        EQUATIONS, // 3-4 node subgraphs enumerated once, 5 node orbits from common neighbor counts
+        ESU        // 3-5 node subgraphs enumerated exactly once each
+    };
+
+    enum Order
+    {
+        INPUT_ORDER,  // count with the nodes as given
+        DEGREE_ORDER, // relabel the nodes by decreasing degree first
+        RCM_ORDER     // relabel the nodes in reverse Cuthill-McKee order first
+    };
+
+    /*
+     * An undirected graph in compressed sparse row form: the neighbors of node i are
+     * adj[offsets[i]] .. adj[offsets[i + 1] - 1], in increasing order.
+     */
+    struct CsrGraph
+    {
+        int V = 0;
+        std::vector<int> offsets = {0};
+        std::vector<int> adj;
+    };
+
+    /*
+     * The GDVs of a graph as 64-bit counts, one row of cols entries per node: the entries of
+     * node i are counts[i * cols] .. counts[i * cols + cols - 1], the rows stored back to back.
+     */
+    struct GdvMatrix
+    {
+        unsigned rows = 0;
+        unsigned cols = 0;
+        std::vector<unsigned long long> counts;
+
+        GdvMatrix() = default;
+        GdvMatrix(unsigned rows, unsigned cols) : rows(rows), cols(cols), counts((size_t)rows * cols, 0) {}
+
+        unsigned long long *operator[](unsigned i) { return counts.data() + (size_t)i * cols; }
+        const unsigned long long *operator[](unsigned i) const { return counts.data() + (size_t)i * cols; }
+
+        bool operator==(const GdvMatrix &) const = default;
+    };
+
+    CsrGraph to_csr(const std::vector<std::vector<unsigned>> &);
+    unsigned long long fingerprint(const CsrGraph &);
+    unsigned gdv_length(int);
+    GdvMatrix count(const CsrGraph &, unsigned, Engine, Order, int);
+    GdvMatrix estimate(const CsrGraph &, unsigned, Order, int, double, unsigned long long, GdvMatrix &);
+    GdvMatrix update(const CsrGraph &, GdvMatrix, const std::vector<std::pair<int, int>> &,
+                     const std::vector<std::pair<int, int>> &, int);
+    void edge_changes(const CsrGraph &, const CsrGraph &, std::vector<std::pair<int, int>> &, std::vector<std::pair<int, int>> &);
 }
 
 #endif
@@ -3,7 +3,18 @@
 
 namespace Hungarian
 {
-    std::vector<std::vector<double>> hungarian(std::vector<std::vector<double>>);
+    enum Solver
+    {
+        MUNKRES,                 // the Munkres step machine over a mask matrix
+        JONKER_VOLGENANT,        // shortest augmenting paths with column duals
+        SPARSE_JONKER_VOLGENANT, // the same over candidate lists only
+        AUCTION,                 // parallel auction, to within a cost unit per node of the optimum
+        EXACT_AUCTION            // parallel auction, optimal for 16-bit fixed point costs
+    };
+
+    std::vector<std::vector<double>> hungarian(Util::CostProvider &, Util::Precision, Solver, unsigned, Util::WarmStart &);
+    std::vector<std::vector<double>> hungarian(const Util::SparseCostMatrix &);
+    std::vector<std::vector<double>> auction(Util::CostProvider &, bool, unsigned);
 }
 
 #endif
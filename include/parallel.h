@@ -0,0 +1,12 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <functional>
+
+namespace Parallel
+{
+    unsigned resolve_threads(unsigned);
+    void for_chunks(unsigned, unsigned, unsigned, std::function<void(unsigned, unsigned, unsigned)>);
+}
+
+#endif
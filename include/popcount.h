@@ -0,0 +1,20 @@
+#ifndef POPCOUNT_H
+#define POPCOUNT_H
+
+namespace Popcount
+{
+    /*
+     * Count the bits set in the intersection of two or three bit rows of the given number of
+     * 64-bit words.
+     */
+    struct Kernels
+    {
+        unsigned long long (*and_count)(const unsigned long long *, const unsigned long long *, unsigned);
+        unsigned long long (*and3_count)(const unsigned long long *, const unsigned long long *, const unsigned long long *, unsigned);
+        const char *name;
+    };
+
+    const Kernels &kernels();
+}
+
+#endif
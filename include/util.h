@@ -1,15 +1,127 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <functional>
+#include <type_traits>
+
 namespace Util
 {
+    /*
+     * The precision an assignment solver holds its working copy of the costs in; the costs are
+     * calculated, cached and written in double whatever it is. Costs are in [0, 1]; in 16-bit
+     * fixed point a cost c is held as round(c * FIXED_ONE), so costs are 1 / FIXED_ONE (about
+     * 1.5e-5) apart.
+     */
+    enum Precision
+    {
+        DOUBLE_COSTS,
+        FLOAT_COSTS,
+        FIXED16_COSTS
+    };
+
+    typedef unsigned short Fixed16;
+    const unsigned FIXED_ONE = 65535;
+
+    /*
+     * Convert a cost to a storage type, and back. Integer types hold fixed point costs.
+     */
+    template <typename T>
+    T to_cost(double cost)
+    {
+        if constexpr (std::is_integral_v<T>)
+        {
+            return T(cost * FIXED_ONE + 0.5);
+        }
+        else
+        {
+            return T(cost);
+        }
+    }
+
+    template <typename T>
+    double from_cost(T cost)
+    {
+        if constexpr (std::is_integral_v<T>)
+        {
+            return double(cost) / FIXED_ONE;
+        }
+        else
+        {
+            return cost;
+        }
+    }
+
+    /*
+     * A sparse cost matrix in compressed sparse row form: the candidate nodes of H for node i
+     * of G are indices[offsets[i]] .. indices[offsets[i + 1] - 1], in increasing order, and
+     * cost values[offsets[i]] .. values[offsets[i + 1] - 1]. Pairs not listed are not candidates:
+     * the sparse solver never aligns them, leaving a row unaligned if its candidates are taken,
+     * and only provider() gives them a cost, the most, 1, for the dense solvers.
+     */
+    struct SparseCostMatrix
+    {
+        unsigned rows = 0;
+        unsigned cols = 0;
+        std::vector<size_t> offsets = {0};
+        std::vector<unsigned> indices;
+        std::vector<double> values;
+    };
+
+    /*
+     * A cost matrix calculated on demand. fill_rows(begin, end, out) writes the costs of rows
+     * begin .. end - 1 to out, back to back; cost(i, j) calculates a single cost. Rows read
+     * through row() are calculated a band of band_rows at a time and kept in a cache of at most
+     * cache_bands bands, the least recently used band giving way. Not safe to share between threads.
+     */
+    struct CostProvider
+    {
+        unsigned rows = 0;
+        unsigned cols = 0;
+        std::function<void(unsigned, unsigned, double *)> fill_rows;
+        std::function<double(unsigned, unsigned)> cost;
+
+        struct Band
+        {
+            unsigned begin = 0;
+            unsigned long long used = 0;
+            std::vector<double> values;
+        };
+
+        unsigned band_rows = 1;
+        unsigned cache_bands = 1;
+        std::vector<Band> cache;
+        unsigned long long uses = 0;
+
+        CostProvider() = default;
+        CostProvider(unsigned, unsigned, std::function<void(unsigned, unsigned, double *)>, std::function<double(unsigned, unsigned)>);
+
+        const double *row(unsigned);
+    };
+
+    /*
+     * The state a Jonker-Volgenant solve of a rows x cols cost matrix ends in, for the next
+     * solve of similar costs to start from. The solver works on the transpose if rows > cols:
+     * assignment holds the column assigned to each of its min(rows, cols) rows, or -1, and
+     * duals the dual of each of its max(rows, cols) columns, in cost units.
+     */
+    struct WarmStart
+    {
+        unsigned rows = 0;
+        unsigned cols = 0;
+        std::vector<int> assignment;
+        std::vector<double> duals;
+    };
+
     std::string now();
     std::string to_string(double, int);
     std::vector<std::string> parse_args(int, char **);
+    std::vector<unsigned> parse_orbits(std::string);
     std::vector<std::vector<unsigned>> binarify(std::vector<std::vector<double>>);
     std::vector<std::vector<double>> normalize(std::vector<std::vector<double>>);
     std::vector<std::vector<double>> one_minus(std::vector<std::vector<double>>);
-    std::vector<std::vector<double>> combine(std::vector<std::vector<double>>, std::vector<std::vector<double>>, double);
+    CostProvider provider(const SparseCostMatrix &);
+    CostProvider combine(const CostProvider &, const std::vector<std::vector<double>> &, double);
+    SparseCostMatrix combine(const SparseCostMatrix &, const std::vector<std::vector<double>> &, double);
 }
 
 #endif
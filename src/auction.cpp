@@ -0,0 +1,228 @@
+// auction.cpp
+// Parallel Auction Algorithm for the Assignment Problem
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "parallel.h"
+#include "util.h"
+#include "hungarian.h"
+
+namespace Hungarian
+{
+    // Factor epsilon is divided by from one scaling phase to the next
+    const long long EPSILON_FACTOR = 8;
+
+    // Bidding rows handed to a worker at a time
+    const unsigned BID_CHUNK = 64;
+
+    /**
+     * Find the alignment with Bertsekas' auction algorithm, the rows bidding in parallel
+     * (Jacobi bidding): in each round, every row without a column bids for its cheapest column
+     * at the current prices, raising its price by the gap to the row's second cheapest column
+     * plus epsilon; each column goes to its highest bid, and the rows that are outbid bid again.
+     * Epsilon is scaled down by EPSILON_FACTOR from phase to phase, the prices carried over.
+     *
+     * The costs are taken as 16-bit fixed point integers (see Util::to_cost) and multiplied by
+     * N + 1, N the number of rows bidding, so that a final epsilon of 1 is less than 1/N of a
+     * cost unit and the alignment is optimal for those costs. Otherwise the last phase has an
+     * epsilon of one cost unit, N + 1, which leaves the total cost within N units of the
+     * optimum. If G is the larger graph, its costs are transposed; the extra columns are bid
+     * for by dummy rows that cost the most, 1, for every column, as in the padded Munkres.
+     * The rows bid the same whatever the number of threads, so the alignment does not
+     * depend on it.
+     *
+     * @param original The cost matrix.
+     * @param exact Whether to run down to an epsilon of 1, for the optimal alignment.
+     * @param threads The number of worker threads, or 0 for one per hardware thread.
+     *
+     * @return The alignment.
+     */
+    std::vector<std::vector<double>> auction(Util::CostProvider &original, bool exact, unsigned threads)
+    {
+        const long long NONE = std::numeric_limits<long long>::min();
+        threads = Parallel::resolve_threads(threads);
+
+        // Copy the costs into the working matrix, validating them as they come
+        bool transpose = original.rows > original.cols;
+        unsigned n = std::min(original.rows, original.cols);
+        unsigned m = std::max(original.rows, original.cols);
+        std::vector<Util::Fixed16> costs((size_t)n * m);
+        for (unsigned r = 0; r < original.rows; ++r)
+        {
+            const double *row = original.row(r);
+            for (unsigned c = 0; c < original.cols; ++c)
+            {
+                if (row[c] < 0 || row[c] > 1)
+                {
+                    std::cout << "Error: Input contains invalid values. All entries must be in range [0,1]." << std::endl;
+                    return {};
+                }
+                costs[transpose ? (size_t)c * m + r : (size_t)r * m + c] = Util::to_cost<Util::Fixed16>(row[c]);
+            }
+        }
+
+        // Rows n .. m - 1 are the dummies
+        const long long scale = (long long)m + 1;
+        const long long dummy_cost = (long long)Util::FIXED_ONE * scale;
+
+        std::vector<long long> prices(m, 0);
+        std::vector<int> owner(m, -1); // row holding each column
+        std::vector<int> holds(m, -1); // column held by each row
+        std::vector<unsigned> bidders;
+        std::vector<unsigned> next_bidders;
+        std::vector<unsigned> bid_cols(m);
+        std::vector<long long> bids(m);
+        std::vector<long long> best_bids(m, NONE);
+        std::vector<unsigned> winners(m);
+        std::vector<unsigned> sold;
+
+        /*
+         * The bids of bidders[begin .. end - 1]: the cheapest column at the current prices, and
+         * the price that makes it as dear as the second cheapest, plus epsilon.
+         */
+        long long epsilon = 0;
+        auto bid = [&](unsigned, unsigned begin, unsigned end)
+        {
+            for (unsigned k = begin; k < end; ++k)
+            {
+                unsigned i = bidders[k];
+                long long first = std::numeric_limits<long long>::max();
+                long long second = first;
+                unsigned best = 0;
+                if (i < n)
+                {
+                    const Util::Fixed16 *row = costs.data() + (size_t)i * m;
+                    for (unsigned j = 0; j < m; ++j)
+                    {
+                        long long t = row[j] * scale + prices[j];
+                        if (t < second)
+                        {
+                            if (t < first)
+                            {
+                                second = first;
+                                first = t;
+                                best = j;
+                            }
+                            else
+                            {
+                                second = t;
+                            }
+                        }
+                    }
+                }
+                else
+                {
+                    // Every column costs a dummy the same; start each dummy's scan at a
+                    // different column, so that they spread over equally priced columns
+                    unsigned start = (unsigned)(((unsigned long long)(i - n) * 2654435761u) % m);
+                    for (unsigned c = 0; c < m; ++c)
+                    {
+                        unsigned j = (start + c < m) ? start + c : start + c - m;
+                        long long t = dummy_cost + prices[j];
+                        if (t < second)
+                        {
+                            if (t < first)
+                            {
+                                second = first;
+                                first = t;
+                                best = j;
+                            }
+                            else
+                            {
+                                second = t;
+                            }
+                        }
+                    }
+                }
+
+                if (m == 1)
+                {
+                    second = first;
+                }
+                bid_cols[k] = best;
+                bids[k] = prices[best] + (second - first) + epsilon;
+            }
+        };
+
+        // Scale epsilon down from the largest cost to the last phase's
+        long long last_epsilon = exact ? 1 : scale;
+        epsilon = std::max(last_epsilon, dummy_cost / EPSILON_FACTOR);
+        while (true)
+        {
+            // Every row starts the phase without a column
+            std::fill(owner.begin(), owner.end(), -1);
+            std::fill(holds.begin(), holds.end(), -1);
+            bidders.clear();
+            for (unsigned i = 0; i < m; ++i)
+            {
+                bidders.push_back(i);
+            }
+
+            while (!bidders.empty())
+            {
+                Parallel::for_chunks(bidders.size(), BID_CHUNK, threads, bid);
+
+                // Each column goes to its highest bid, the first of equal bids
+                sold.clear();
+                for (unsigned k = 0; k < bidders.size(); ++k)
+                {
+                    unsigned j = bid_cols[k];
+                    if (best_bids[j] == NONE)
+                    {
+                        sold.push_back(j);
+                    }
+                    if (bids[k] > best_bids[j])
+                    {
+                        best_bids[j] = bids[k];
+                        winners[j] = bidders[k];
+                    }
+                }
+
+                // The outbid rows, and the rows the columns are taken from, bid again
+                next_bidders.clear();
+                for (unsigned k = 0; k < bidders.size(); ++k)
+                {
+                    if (winners[bid_cols[k]] != bidders[k])
+                    {
+                        next_bidders.push_back(bidders[k]);
+                    }
+                }
+                for (unsigned j : sold)
+                {
+                    if (owner[j] >= 0)
+                    {
+                        holds[owner[j]] = -1;
+                        next_bidders.push_back(owner[j]);
+                    }
+                    owner[j] = winners[j];
+                    holds[winners[j]] = j;
+                    prices[j] = best_bids[j];
+                    best_bids[j] = NONE;
+                }
+                bidders.swap(next_bidders);
+            }
+
+            if (epsilon == last_epsilon)
+            {
+                break;
+            }
+            epsilon = std::max(last_epsilon, epsilon / EPSILON_FACTOR);
+        }
+
+        // The column of H assigned to each node of G
+        std::vector<std::vector<double>> alignment(original.rows, std::vector<double>(original.cols, 0));
+        for (unsigned i = 0; i < n; ++i)
+        {
+            unsigned r = transpose ? holds[i] : i;
+            unsigned c = transpose ? i : holds[i];
+            alignment[r][c] = 1 - original.cost(r, c);
+        }
+
+        return alignment;
+    }
+}
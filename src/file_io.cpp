@@ -4,12 +4,19 @@
 
 #include <algorithm>
 #include <array>
+#include <cerrno>
+#include <cstdio>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <random>
 #include <vector>
 #include <sys/stat.h>
 
+#include "graphcrunch.h"
+#include "util.h"
+
 namespace FileIO
 {
     /**
@@ -288,101 +295,6 @@ namespace FileIO
 
     /* FILE INPUT */
 
-    /**
-     * Parse the given csv adjacency matrix file into a list
-     *
-     * @param filepath_in the path to the input file.
-     * @param filepath_out the path to the output file.
-     *
-     * @return Path to the GraphCrunch-friendly version of the input graph.
-     *
-     * @throws std::runtime_error If the file could not be opened, or the output file could not be created.
-     */
-    std::string graphcrunch_in(std::string filepath_in, std::string filepath_out)
-    {
-        // Identify the delimiter for this csv
-        char delim;
-        try
-        {
-            delim = detect_delimiter(filepath_in);
-        }
-        catch (const std::runtime_error &e)
-        {
-            throw e;
-        }
-
-        // Open the input file
-        std::ifstream fin;
-        fin.exceptions(std::ofstream::badbit);
-        try
-        {
-            fin.open(filepath_in);
-        }
-        catch (const std::ifstream::failure &e)
-        {
-            throw std::runtime_error("Unable to open file " + filepath_in);
-        }
-
-        // Parse the file into a matrix
-        std::vector<std::vector<double>> matrix;
-        std::string line;
-        while (std::getline(fin, line))
-        {
-            std::stringstream ss(line);
-            std::string cell;
-            std::vector<double> row;
-            while (std::getline(ss, cell, delim))
-            {
-                try
-                {
-                    row.push_back(std::stod(cell));
-                }
-                catch (std::invalid_argument const &)
-                {
-                    row.push_back(0);
-                }
-            }
-            matrix.push_back(row);
-        }
-
-        // Convert the matrix into a list
-        std::vector<std::array<unsigned, 2>> list;
-        for (unsigned i = 1; i < matrix.size(); ++i)
-        {
-            for (unsigned j = i; j < matrix[i].size(); ++j)
-            {
-                if (matrix[i][j] != 0)
-                {
-                    list.push_back({i, j});
-                }
-            }
-        }
-
-        // Open the output file
-        std::string out_filepath = filepath_out + "_gc.csv";
-        std::ofstream outfile;
-        outfile.exceptions(std::ofstream::badbit);
-        try
-        {
-            outfile.open(out_filepath);
-        }
-        catch (const std::ofstream::failure &e)
-        {
-            throw std::runtime_error("Unable to open file " + out_filepath);
-        }
-
-        // Write the list to a file
-        outfile << (matrix.size() - 1) << std::endl;
-        outfile << list.size() << std::endl;
-        for (auto &row : list)
-        {
-            outfile << row[0] << " " << row[1] << std::endl;
-        }
-        outfile.close();
-
-        return out_filepath;
-    }
-
     /**
      * Parse the file at the given path into a matrix.
      * Require that the file is a CSV, and that the first row and column are labels.
@@ -548,7 +460,7 @@ namespace FileIO
      *
      * @throws std::runtime_error If the file could not be written.
      */
-    void gdvs_to_file(std::string filepath, std::vector<std::string> labels, std::vector<std::vector<unsigned>> gdvs)
+    void gdvs_to_file(std::string filepath, std::vector<std::string> labels, const GraphCrunch::GdvMatrix &gdvs)
     {
         std::ofstream fout;
         fout.exceptions(std::ofstream::badbit);
@@ -564,7 +476,7 @@ namespace FileIO
         for (unsigned i = 0; i < labels.size(); ++i)
         {
             fout << labels[i];
-            for (unsigned j = 0; j < gdvs[i].size(); ++j)
+            for (unsigned j = 0; j < gdvs.cols; ++j)
             {
                 fout << "," << gdvs[i][j];
             }
@@ -617,6 +529,50 @@ namespace FileIO
         fout.close();
     }
 
+    /**
+     * Write the cost matrix to a file.
+     *
+     * @param filepath The path to the file to write the cost matrix to.
+     * @param g_labels Labels for the G graph.
+     * @param h_labels Labels for the H graph.
+     * @param matrix The matrix to write to the file.
+     *
+     * @throws std::runtime_error If the file could not be written.
+     */
+    void matrix_to_file(std::string filepath, const std::vector<std::string> &g_labels, const std::vector<std::string> &h_labels,
+                        Util::CostProvider &matrix)
+    {
+        // Create and open the file
+        std::ofstream fout;
+        fout.exceptions(std::ofstream::badbit);
+        try
+        {
+            fout.open(filepath);
+        }
+        catch (const std::ofstream::failure &e)
+        {
+            throw std::runtime_error("Unable to open file " + filepath);
+        }
+
+        fout << "\"\"";
+        for (unsigned i = 0; i < matrix.cols; ++i)
+        {
+            fout << "," << h_labels[i];
+        }
+        for (unsigned i = 0; i < matrix.rows; ++i)
+        {
+            fout << std::endl
+                 << g_labels[i];
+            const double *row = matrix.row(i);
+            for (unsigned j = 0; j < matrix.cols; ++j)
+            {
+                fout << "," << row[j];
+            }
+        }
+
+        fout.close();
+    }
+
     /**
      * Write the given alignment to a csv file as a matrix.
      *
@@ -730,4 +686,234 @@ namespace FileIO
         fout.close();
     }
 
+    /* GDV CACHE */
+
+    const char GDV_CACHE_MAGIC[4] = {'G', 'D', 'V', 'C'};
+    const unsigned GDV_CACHE_VERSION = 2;
+
+    /*
+     * The header at the start of each cache file, followed by the GDV matrix as
+     * rows * cols 64-bit unsigned ints in row order (native byte order).
+     */
+    struct GdvCacheHeader
+    {
+        char magic[4];
+        unsigned version;
+        unsigned long long key;
+        unsigned rows;
+        unsigned cols;
+    };
+
+    /**
+     * Returns the path of the cache file for the given key, creating the cache directory if needed.
+     *
+     * @param cache_dir The directory holding the cache files.
+     * @param key The hash of the graph, from GraphCrunch::fingerprint.
+     * @param cols The length of the GDVs, which differs by the graphlet size counted.
+     *
+     * @return The path of the cache file for the given key.
+     *
+     * @throws std::runtime_error If the cache directory could not be created.
+     */
+    std::string gdv_cache_path(std::string cache_dir, unsigned long long key, unsigned cols)
+    {
+        #ifdef _WIN32 // Windows
+        if (mkdir(cache_dir.c_str()) == -1)
+        #else // Unix
+        if (mkdir(cache_dir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) == -1)
+        #endif
+        {
+            if (errno != EEXIST)
+            {
+                throw std::runtime_error("Unable to create cache directory " + cache_dir);
+            }
+        }
+
+        std::ostringstream oss;
+        oss << cache_dir << "/" << std::hex << std::setw(16) << std::setfill('0') << key << std::dec << "-" << cols << ".gdv";
+        return oss.str();
+    }
+
+    /**
+     * Read the GDVs stored in the given cache file.
+     * A missing, truncated, or mismatched file is treated as a cache miss.
+     *
+     * @param filepath The path to the cache file.
+     * @param key The hash of the graph the GDVs are wanted for.
+     * @param rows The number of nodes in the graph.
+     * @param cols The length of the GDVs wanted.
+     * @param gdvs Set to the cached GDVs on a hit.
+     *
+     * @return True if the GDVs were read from the cache, false otherwise.
+     */
+    bool cache_to_gdvs(std::string filepath, unsigned long long key, unsigned rows, unsigned cols, GraphCrunch::GdvMatrix &gdvs)
+    {
+        std::ifstream fin(filepath, std::ios::binary);
+        if (!fin.good())
+        {
+            return false;
+        }
+
+        GdvCacheHeader header;
+        if (!fin.read((char *)&header, sizeof(header)) ||
+            !std::equal(header.magic, header.magic + 4, GDV_CACHE_MAGIC) ||
+            header.version != GDV_CACHE_VERSION || header.key != key || header.rows != rows || header.cols != cols)
+        {
+            return false;
+        }
+
+        GraphCrunch::GdvMatrix cached(rows, cols);
+        if (!fin.read((char *)cached.counts.data(), cached.counts.size() * sizeof(unsigned long long)))
+        {
+            return false;
+        }
+
+        gdvs = std::move(cached);
+        return true;
+    }
+
+    /**
+     * Write the GDVs to the given cache file.
+     * The file is written under a temporary name and then renamed into place, so that
+     * concurrent runs never read a partial file.
+     *
+     * @param filepath The path to the cache file.
+     * @param key The hash of the graph the GDVs belong to.
+     * @param gdvs The GDVs to store.
+     *
+     * @throws std::runtime_error If the file could not be written.
+     */
+    void gdvs_to_cache(std::string filepath, unsigned long long key, const GraphCrunch::GdvMatrix &gdvs)
+    {
+        auto temp_filepath = filepath + ".tmp" + std::to_string(std::random_device()());
+
+        std::ofstream fout;
+        fout.exceptions(std::ofstream::badbit);
+        try
+        {
+            fout.open(temp_filepath, std::ios::binary);
+        }
+        catch (const std::ofstream::failure &e)
+        {
+            throw std::runtime_error("Unable to open file " + temp_filepath);
+        }
+
+        GdvCacheHeader header;
+        std::copy(GDV_CACHE_MAGIC, GDV_CACHE_MAGIC + 4, header.magic);
+        header.version = GDV_CACHE_VERSION;
+        header.key = key;
+        header.rows = gdvs.rows;
+        header.cols = gdvs.cols;
+
+        fout.write((const char *)&header, sizeof(header));
+        fout.write((const char *)gdvs.counts.data(), gdvs.counts.size() * sizeof(unsigned long long));
+        fout.close();
+
+        if (fout.fail() || std::rename(temp_filepath.c_str(), filepath.c_str()) != 0)
+        {
+            std::remove(temp_filepath.c_str());
+            throw std::runtime_error("Unable to write cache file " + filepath);
+        }
+    }
+
+    /* WARM START */
+
+    const char WARM_START_MAGIC[4] = {'W', 'A', 'R', 'M'};
+    const unsigned WARM_START_VERSION = 1;
+
+    /*
+     * The header at the start of each warm start file, followed by the assignment as
+     * min(rows, cols) 32-bit ints and the duals as max(rows, cols) doubles (native byte order).
+     */
+    struct WarmStartHeader
+    {
+        char magic[4];
+        unsigned version;
+        unsigned rows;
+        unsigned cols;
+    };
+
+    /**
+     * Read the solver state stored in the given warm start file.
+     * A missing, truncated, or mismatched file is treated as no warm start.
+     *
+     * @param filepath The path to the warm start file.
+     * @param rows The number of rows of the cost matrix to be solved.
+     * @param cols The number of columns of the cost matrix to be solved.
+     * @param warm Set to the stored state if there is one.
+     *
+     * @return True if the state was read, false otherwise.
+     */
+    bool file_to_warm_start(std::string filepath, unsigned rows, unsigned cols, Util::WarmStart &warm)
+    {
+        std::ifstream fin(filepath, std::ios::binary);
+        if (!fin.good())
+        {
+            return false;
+        }
+
+        WarmStartHeader header;
+        if (!fin.read((char *)&header, sizeof(header)) ||
+            !std::equal(header.magic, header.magic + 4, WARM_START_MAGIC) ||
+            header.version != WARM_START_VERSION || header.rows != rows || header.cols != cols)
+        {
+            return false;
+        }
+
+        Util::WarmStart stored;
+        stored.rows = rows;
+        stored.cols = cols;
+        stored.assignment.resize(std::min(rows, cols));
+        stored.duals.resize(std::max(rows, cols));
+        if (!fin.read((char *)stored.assignment.data(), stored.assignment.size() * sizeof(int)) ||
+            !fin.read((char *)stored.duals.data(), stored.duals.size() * sizeof(double)))
+        {
+            return false;
+        }
+
+        warm = std::move(stored);
+        return true;
+    }
+
+    /**
+     * Write the solver state to the given warm start file, under a temporary name first as
+     * for the GDV cache.
+     *
+     * @param filepath The path to the warm start file.
+     * @param warm The state to store.
+     *
+     * @throws std::runtime_error If the file could not be written.
+     */
+    void warm_start_to_file(std::string filepath, const Util::WarmStart &warm)
+    {
+        auto temp_filepath = filepath + ".tmp" + std::to_string(std::random_device()());
+
+        std::ofstream fout;
+        fout.exceptions(std::ofstream::badbit);
+        try
+        {
+            fout.open(temp_filepath, std::ios::binary);
+        }
+        catch (const std::ofstream::failure &e)
+        {
+            throw std::runtime_error("Unable to open file " + temp_filepath);
+        }
+
+        WarmStartHeader header;
+        std::copy(WARM_START_MAGIC, WARM_START_MAGIC + 4, header.magic);
+        header.version = WARM_START_VERSION;
+        header.rows = warm.rows;
+        header.cols = warm.cols;
+
+        fout.write((const char *)&header, sizeof(header));
+        fout.write((const char *)warm.assignment.data(), warm.assignment.size() * sizeof(int));
+        fout.write((const char *)warm.duals.data(), warm.duals.size() * sizeof(double));
+        fout.close();
+
+        if (fout.fail() || std::rename(temp_filepath.c_str(), filepath.c_str()) != 0)
+        {
+            std::remove(temp_filepath.c_str());
+            throw std::runtime_error("Unable to write warm start file " + filepath);
+        }
+    }
 }
@@ -2,13 +2,28 @@
 // Topological Similarity Calculator (from GRAAL)
 // Reed Nelson
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <iostream>
+#include <type_traits>
+
+#include "graphcrunch.h"
+#include "parallel.h"
+#include "util.h"
+#include "gdvs_dist.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define GDVS_DIST_X86 1
+#endif
 
 namespace GDVs_Dist
 {
-    const double O[73] = {
+    constexpr int O[73] = {
         1, 2, 2, 2, 3, 4, 3, 3, 4, 3,
         4, 4, 4, 4, 3, 4, 6, 5, 4, 5,
         6, 6, 4, 4, 4, 5, 7, 4, 6, 6,
@@ -18,7 +33,6 @@ namespace GDVs_Dist
         8, 6, 6, 8, 7, 6, 7, 7, 8, 5,
         6, 6, 4};
     const double WEIGHT_SUM = 45.4827;
-    double alpha;
 
     // // To calculate WEIGHT_SUM:
     // double weight_sum = 0;
@@ -28,64 +42,387 @@ namespace GDVs_Dist
     // }
 
     /*
-     * The weight of orbit i, accounting for dependencies between orbits.
+     * 1 - log10(o) / log10(73) for o = 1..9, the weight of an orbit that o orbits depend on.
+     * Generated with printf("%.17g", 1 - (std::log10(o) / std::log10(73))).
+     */
+    constexpr double O_WEIGHT[10] = {
+        0, 1, 0.83844453255700357, 0.74394064231637314, 0.67688906511400726,
+        0.62487982126144614, 0.58238517487337682, 0.5464564632885871, 0.51533359767101095, 0.48788128463274627};
+
+    constexpr std::array<double, 73> make_weights()
+    {
+        std::array<double, 73> weights{};
+        for (unsigned i = 0; i < 73; ++i)
+        {
+            weights[i] = O_WEIGHT[O[i]];
+        }
+        return weights;
+    }
+
+    /*
+     * The weight of each orbit, accounting for dependencies between orbits.
+     */
+    constexpr std::array<double, 73> WEIGHTS = make_weights();
+
+    /*
+     * The sum of the weights of the first n orbits, the most a GDV distance over them can be.
+     */
+    double weight_sum(unsigned n)
+    {
+        if (n == 73)
+        {
+            return WEIGHT_SUM;
+        }
+
+        double sum = 0;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            sum += WEIGHTS[i];
+        }
+        return sum;
+    }
+
+    /*
+     * The GDVs of a graph in the form a metric compares them in: for node v and orbit i, x and
+     * scale hold the values the metric's term (ScaledDifference or Product) is taken over. Each
+     * row is padded from 73 to LANES entries (x 0 and scale 0, so the padding adds nothing),
+     * a whole number of 512-bit vectors. Orbits left out of the comparison are zero as well.
+     */
+    const unsigned LANES = 80;
+
+    // Nodes of G and of H per tile of the cost matrix; the H rows of a tile take 40 KiB
+    const unsigned TILE_ROWS = 32;
+
+    // Nodes of H per block of tiles handed to one worker; the H rows of a block take 640 KiB,
+    // so they stay in L2 while the worker runs the G tiles of its share past them
+    const unsigned BLOCK_ROWS = 16 * TILE_ROWS;
+
+    struct LogGdvs
+    {
+        unsigned rows = 0;
+        std::vector<double> x;
+        std::vector<double> scale;
+
+        const double *x_row(unsigned v) const { return x.data() + (size_t)v * LANES; }
+        const double *scale_row(unsigned v) const { return scale.data() + (size_t)v * LANES; }
+    };
+
+    /*
+     * Everything the costs between the nodes of G and H are calculated from.
      */
-    double weight(unsigned i)
+    struct CostInputs
     {
-        return 1 - (std::log10(O[i]) / std::log10(73));
+        Metric metric = GRAAL;
+        std::array<bool, 73> compared{}; // the orbits the metric runs over
+        double alpha = 0;
+        double weight_total = 0; // the most a ScaledDifference sum can be
+        LogGdvs g_logs;
+        LogGdvs h_logs;
+        std::vector<unsigned long long> g_degs;
+        std::vector<unsigned long long> h_degs;
+        unsigned long long g_max_deg = 0;
+        unsigned long long h_max_deg = 0;
+    };
+
+    /*
+     * Take the logarithms of every GDV entry once, so that the pairwise costs need none:
+     * - GRAAL: x = log10(count + 1) and scale = weight(i) / log10(count + 2);
+     * - AGREEMENT: the same without the orbit weights, scale = 1 / log10(count + 2);
+     * - WEIGHTED_L1: x = log10(count + 1) and scale = weight(i) / the largest x of orbit i in
+     *   either graph, the same for every node;
+     * - COSINE: x = log10(count + 1), scaled to a unit vector.
+     */
+    LogGdvs log_gdvs(const GraphCrunch::GdvMatrix &gdvs, const CostInputs &inputs, const std::array<double, 73> &max_x)
+    {
+        LogGdvs logs;
+        logs.rows = gdvs.rows;
+        logs.x.assign((size_t)gdvs.rows * LANES, 0);
+        logs.scale.assign((size_t)gdvs.rows * LANES, 0);
+        for (unsigned v = 0; v < gdvs.rows; ++v)
+        {
+            double *x = logs.x.data() + (size_t)v * LANES;
+            double *scale = logs.scale.data() + (size_t)v * LANES;
+            double norm = 0;
+            for (unsigned i = 0; i < gdvs.cols && i < 73; ++i)
+            {
+                if (!inputs.compared[i])
+                {
+                    continue;
+                }
+
+                x[i] = std::log10(gdvs[v][i] + 1);
+                switch (inputs.metric)
+                {
+                case GRAAL:
+                    scale[i] = WEIGHTS[i] / std::log10(gdvs[v][i] + 2);
+                    break;
+                case AGREEMENT:
+                    scale[i] = 1 / std::log10(gdvs[v][i] + 2);
+                    break;
+                case WEIGHTED_L1:
+                    scale[i] = (max_x[i] > 0) ? WEIGHTS[i] / max_x[i] : 0;
+                    break;
+                case COSINE:
+                    norm += x[i] * x[i];
+                    break;
+                }
+            }
+
+            if (inputs.metric == COSINE && norm > 0)
+            {
+                norm = std::sqrt(norm);
+                for (unsigned i = 0; i < LANES; ++i)
+                {
+                    x[i] /= norm;
+                }
+            }
+        }
+
+        return logs;
     }
 
     /*
-     * The distance between the ith orbits of nodes v and u.
+     * The weighted distance between one orbit of nodes v and u, as GRAAL has it:
+     * |log10(vi + 1) - log10(ui + 1)| / log10(max(vi, ui) + 2) * weight(i).
+     * As log10 is increasing, weight(i) / log10(max(vi, ui) + 2) is the smaller of the two scales.
      */
-    double distance(unsigned vi, unsigned ui, unsigned i)
+    double distance(double v_log1, double u_log1, double v_scale, double u_scale)
     {
         double ret = 0;
-        ret = std::log10(vi + 1) - std::log10(ui + 1);
+        ret = v_log1 - u_log1;
         ret = std::abs(ret);
-        ret /= std::log10(std::max(vi, ui) + 2);
-        ret *= weight(i);
+        ret *= std::min(v_scale, u_scale);
 
         return ret;
     }
 
     /*
-     * The signature similarity between nodes v and u. (1 - the distance between v and u).
+     * The per-orbit terms the metrics add up, each with a scalar, AVX2 and AVX-512 form, and
+     * the similarity the sum of the terms makes. The distance kernels are instantiated once per
+     * term, so each metric runs its own inner loop.
+     *
+     * ScaledDifference: |xv - xu| * min(scale_v, scale_u), for GRAAL, AGREEMENT and WEIGHTED_L1;
+     * the similarity is 1 - the sum, over the most it can be.
      */
-    double similarity(std::vector<unsigned> v, std::vector<unsigned> u)
+    struct ScaledDifference
     {
-        double dist = 0;
-        for (unsigned i = 0; i < 73; ++i)
+        static double scalar(double vx, double ux, double v_scale, double u_scale)
+        {
+            return distance(vx, ux, v_scale, u_scale);
+        }
+
+        static double similarity(double sum, const CostInputs &inputs)
+        {
+            return 1 - (sum / inputs.weight_total);
+        }
+
+#ifdef GDVS_DIST_X86
+        __attribute__((target("avx2"))) static __m256d avx2(__m256d vx, __m256d ux, __m256d v_scale, __m256d u_scale)
+        {
+            __m256d d = _mm256_andnot_pd(_mm256_set1_pd(-0.0), _mm256_sub_pd(vx, ux));
+            return _mm256_mul_pd(d, _mm256_min_pd(v_scale, u_scale));
+        }
+
+        /*
+         * The unmasked _mm512_min_pd trips a false -Wmaybe-uninitialized in the GCC 12 headers.
+         */
+        __attribute__((target("avx512f"))) static __m512d avx512(__m512d vx, __m512d ux, __m512d v_scale, __m512d u_scale)
+        {
+            __m512i d = _mm512_castpd_si512(_mm512_sub_pd(vx, ux));
+            d = _mm512_and_epi64(d, _mm512_set1_epi64(0x7fffffffffffffffLL));
+            return _mm512_mul_pd(_mm512_castsi512_pd(d), _mm512_maskz_min_pd((__mmask8)0xff, v_scale, u_scale));
+        }
+#endif
+    };
+
+    /*
+     * Product: xv * xu, for COSINE; the sum is the similarity, up to rounding.
+     */
+    struct Product
+    {
+        static double scalar(double vx, double ux, double, double)
+        {
+            return vx * ux;
+        }
+
+        static double similarity(double sum, const CostInputs &)
         {
-            dist += distance(v[i], u[i], i);
+            return std::min(sum, 1.0);
         }
 
-        return 1 - (dist / WEIGHT_SUM);
+#ifdef GDVS_DIST_X86
+        __attribute__((target("avx2"))) static __m256d avx2(__m256d vx, __m256d ux, __m256d, __m256d)
+        {
+            return _mm256_mul_pd(vx, ux);
+        }
+
+        __attribute__((target("avx512f"))) static __m512d avx512(__m512d vx, __m512d ux, __m512d, __m512d)
+        {
+            return _mm512_mul_pd(vx, ux);
+        }
+#endif
+    };
+
+    /*
+     * Kernels for the sums of a term between nodes g_begin..g_end-1 of G and h_begin..h_end-1
+     * of H, written to sums[(v - g_begin) * sums_stride + (u - h_begin)]. They differ only in
+     * the order the orbits are added up in, by a few units in the last place.
+     */
+    typedef void (*DistanceTile)(const LogGdvs &, unsigned, unsigned, const LogGdvs &, unsigned, unsigned, double *, unsigned);
+
+    template <class Term>
+    void distance_tile_scalar(const LogGdvs &g_logs, unsigned g_begin, unsigned g_end,
+                              const LogGdvs &h_logs, unsigned h_begin, unsigned h_end, double *sums, unsigned sums_stride)
+    {
+        for (unsigned v = g_begin; v < g_end; ++v)
+        {
+            const double *v_x = g_logs.x_row(v);
+            const double *v_scale = g_logs.scale_row(v);
+            for (unsigned u = h_begin; u < h_end; ++u)
+            {
+                const double *u_x = h_logs.x_row(u);
+                const double *u_scale = h_logs.scale_row(u);
+                double sum = 0;
+                for (unsigned i = 0; i < LANES; ++i)
+                {
+                    sum += Term::scalar(v_x[i], u_x[i], v_scale[i], u_scale[i]);
+                }
+                sums[(size_t)(v - g_begin) * sums_stride + (u - h_begin)] = sum;
+            }
+        }
+    }
+
+#ifdef GDVS_DIST_X86
+    /*
+     * Four orbits per instruction, with two accumulators to hide the latency of the adds.
+     */
+    template <class Term>
+    __attribute__((target("avx2"))) void distance_tile_avx2(const LogGdvs &g_logs, unsigned g_begin, unsigned g_end,
+                                                            const LogGdvs &h_logs, unsigned h_begin, unsigned h_end,
+                                                            double *sums, unsigned sums_stride)
+    {
+        for (unsigned v = g_begin; v < g_end; ++v)
+        {
+            const double *v_x = g_logs.x_row(v);
+            const double *v_scale = g_logs.scale_row(v);
+            for (unsigned u = h_begin; u < h_end; ++u)
+            {
+                const double *u_x = h_logs.x_row(u);
+                const double *u_scale = h_logs.scale_row(u);
+                __m256d sum0 = _mm256_setzero_pd();
+                __m256d sum1 = _mm256_setzero_pd();
+                for (unsigned i = 0; i < LANES; i += 8)
+                {
+                    __m256d d0 = Term::avx2(_mm256_loadu_pd(v_x + i), _mm256_loadu_pd(u_x + i),
+                                            _mm256_loadu_pd(v_scale + i), _mm256_loadu_pd(u_scale + i));
+                    __m256d d1 = Term::avx2(_mm256_loadu_pd(v_x + i + 4), _mm256_loadu_pd(u_x + i + 4),
+                                            _mm256_loadu_pd(v_scale + i + 4), _mm256_loadu_pd(u_scale + i + 4));
+                    sum0 = _mm256_add_pd(sum0, d0);
+                    sum1 = _mm256_add_pd(sum1, d1);
+                }
+
+                alignas(32) double lanes[4];
+                _mm256_store_pd(lanes, _mm256_add_pd(sum0, sum1));
+                sums[(size_t)(v - g_begin) * sums_stride + (u - h_begin)] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            }
+        }
     }
 
     /*
-     * The cost of aligning nodes v and u.
+     * Eight orbits per instruction, as above.
      */
-    double cost(std::vector<unsigned> v, std::vector<unsigned> u, unsigned g_max_deg, unsigned h_max_deg)
+    template <class Term>
+    __attribute__((target("avx512f"))) void distance_tile_avx512(const LogGdvs &g_logs, unsigned g_begin, unsigned g_end,
+                                                                 const LogGdvs &h_logs, unsigned h_begin, unsigned h_end,
+                                                                 double *sums, unsigned sums_stride)
     {
+        for (unsigned v = g_begin; v < g_end; ++v)
+        {
+            const double *v_x = g_logs.x_row(v);
+            const double *v_scale = g_logs.scale_row(v);
+            for (unsigned u = h_begin; u < h_end; ++u)
+            {
+                const double *u_x = h_logs.x_row(u);
+                const double *u_scale = h_logs.scale_row(u);
+                __m512d sum0 = _mm512_setzero_pd();
+                __m512d sum1 = _mm512_setzero_pd();
+                for (unsigned i = 0; i < LANES; i += 16)
+                {
+                    __m512d d0 = Term::avx512(_mm512_loadu_pd(v_x + i), _mm512_loadu_pd(u_x + i),
+                                              _mm512_loadu_pd(v_scale + i), _mm512_loadu_pd(u_scale + i));
+                    __m512d d1 = Term::avx512(_mm512_loadu_pd(v_x + i + 8), _mm512_loadu_pd(u_x + i + 8),
+                                              _mm512_loadu_pd(v_scale + i + 8), _mm512_loadu_pd(u_scale + i + 8));
+                    sum0 = _mm512_add_pd(sum0, d0);
+                    sum1 = _mm512_add_pd(sum1, d1);
+                }
+
+                alignas(64) double lanes[8];
+                _mm512_store_pd(lanes, _mm512_add_pd(sum0, sum1));
+                sums[(size_t)(v - g_begin) * sums_stride + (u - h_begin)] =
+                    ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+            }
+        }
+    }
+#endif
+
+    /*
+     * Pick the widest kernel for the given term the CPU we are running on supports.
+     */
+    template <class Term>
+    DistanceTile select_distance_tile()
+    {
+#ifdef GDVS_DIST_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            return distance_tile_avx512<Term>;
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return distance_tile_avx2<Term>;
+        }
+#endif
+        return distance_tile_scalar<Term>;
+    }
+
+    // The widest kernels the CPU we are running on supports, one per term
+    const DistanceTile difference_tile = select_distance_tile<ScaledDifference>();
+    const DistanceTile product_tile = select_distance_tile<Product>();
+
+    template <class Term>
+    DistanceTile distance_tile()
+    {
+        return std::is_same_v<Term, Product> ? product_tile : difference_tile;
+    }
+
+    /*
+     * The cost of aligning node i of G and node j of H, given the sum of the metric's terms between them.
+     */
+    template <class Term>
+    double cost(const CostInputs &inputs, unsigned i, unsigned j, double sum)
+    {
+        unsigned long long v_deg = inputs.g_degs[i];
+        unsigned long long u_deg = inputs.h_degs[j];
+
         // Return maximal cost if either node is a loner
-        if (v[0] == 0 || u[0] == 0)
+        if (v_deg == 0 || u_deg == 0)
         {
             return 1;
         }
 
-        double node_degs = (v[0] + u[0]) / (g_max_deg + h_max_deg);
+        double node_degs = (v_deg + u_deg) / (inputs.g_max_deg + inputs.h_max_deg);
 
-        return 1 - ((1 - alpha) * node_degs + alpha * similarity(v, u)); // originally 2 - ...
+        double similarity = Term::similarity(sum, inputs);
+        return 1 - ((1 - inputs.alpha) * node_degs + inputs.alpha * similarity); // originally 2 - ...
     }
 
     /*
      * The maximum degree of all the nodes in the given graph.
      */
-    unsigned max_deg(std::vector<std::vector<unsigned>> gdvs)
+    unsigned long long max_deg(const GraphCrunch::GdvMatrix &gdvs)
     {
-        unsigned max = 0;
-        for (unsigned i = 0; i < gdvs.size(); ++i)
+        unsigned long long max = 0;
+        for (unsigned i = 0; i < gdvs.rows; ++i)
         {
             if (max < gdvs[i][0])
             {
@@ -96,32 +433,428 @@ namespace GDVs_Dist
         return max;
     }
 
+    CostInputs cost_inputs(const GraphCrunch::GdvMatrix &g_gdvs, const GraphCrunch::GdvMatrix &h_gdvs, double alpha, const Measure &measure)
+    {
+        CostInputs inputs;
+        inputs.metric = measure.metric;
+        inputs.alpha = alpha;
+
+        // Compare the selected orbits, or all of them, as far as the GDVs go
+        unsigned cols = g_gdvs.rows == 0 ? 73 : g_gdvs.cols;
+        for (unsigned i = 0; i < cols && i < 73; ++i)
+        {
+            inputs.compared[i] = measure.orbits.empty();
+        }
+        for (unsigned i : measure.orbits)
+        {
+            if (i < cols && i < 73)
+            {
+                inputs.compared[i] = true;
+            }
+        }
+
+        // The most a sum of ScaledDifference terms can be: every term is at most its weight
+        if (measure.orbits.empty() && inputs.metric != AGREEMENT)
+        {
+            inputs.weight_total = weight_sum(cols);
+        }
+        else
+        {
+            for (unsigned i = 0; i < 73; ++i)
+            {
+                if (inputs.compared[i])
+                {
+                    inputs.weight_total += (inputs.metric == AGREEMENT) ? 1 : WEIGHTS[i];
+                }
+            }
+        }
+
+        // Calculate the highest degree among all the nodes in G, H
+        inputs.g_max_deg = max_deg(g_gdvs);
+        inputs.h_max_deg = max_deg(h_gdvs);
+        for (unsigned i = 0; i < g_gdvs.rows; ++i)
+        {
+            inputs.g_degs.push_back(g_gdvs[i][0]);
+        }
+        for (unsigned j = 0; j < h_gdvs.rows; ++j)
+        {
+            inputs.h_degs.push_back(h_gdvs[j][0]);
+        }
+
+        // The largest log count of each orbit in either graph, for WEIGHTED_L1
+        std::array<double, 73> max_x{};
+        for (const GraphCrunch::GdvMatrix *gdvs : {&g_gdvs, &h_gdvs})
+        {
+            for (unsigned v = 0; v < gdvs->rows; ++v)
+            {
+                for (unsigned i = 0; i < gdvs->cols && i < 73; ++i)
+                {
+                    max_x[i] = std::max(max_x[i], std::log10((*gdvs)[v][i] + 1));
+                }
+            }
+        }
+
+        // Take the logarithms of the GDV entries of G and H
+        inputs.g_logs = log_gdvs(g_gdvs, inputs, max_x);
+        inputs.h_logs = log_gdvs(h_gdvs, inputs, max_x);
+
+        return inputs;
+    }
+
     /*
-     * Calculate the topological similarity between the graphs at the given paths.
+     * Calculate the costs of the nodes g_begin..g_end-1 of G against every node of H into
+     * costs, one row of H costs after another. The rows are
+     * split into blocks of BLOCK_ROWS nodes of H by TILE_ROWS nodes of G, which the workers
+     * fill in directly; every entry is independent of the others.
      */
-    std::vector<std::vector<double>> gdvs_dist(
-        std::vector<std::vector<unsigned>> g_gdvs, std::vector<std::vector<unsigned>> h_gdvs, double alpha)
+    template <class Term>
+    void fill_tiles(const CostInputs &inputs, unsigned g_begin, unsigned g_end, double *costs, unsigned threads)
     {
-        GDVs_Dist::alpha = alpha;
+        unsigned h_rows = inputs.h_logs.rows;
+        const DistanceTile tile = distance_tile<Term>();
 
-        // Calculate the highest degree among all the nodes in G, H
-        unsigned g_max_deg = max_deg(g_gdvs);
-        unsigned h_max_deg = max_deg(h_gdvs);
+        // Number the blocks H block by H block, so that each worker's share of the blocks
+        // mostly runs over the same H rows
+        unsigned g_tiles = (g_end - g_begin + TILE_ROWS - 1) / TILE_ROWS;
+        unsigned h_blocks = (h_rows + BLOCK_ROWS - 1) / BLOCK_ROWS;
+        auto fill_blocks = [&](unsigned, unsigned begin, unsigned end)
+        {
+            double sums[TILE_ROWS * TILE_ROWS];
+            for (unsigned b = begin; b < end; ++b)
+            {
+                unsigned tile_begin = g_begin + (b % g_tiles) * TILE_ROWS;
+                unsigned tile_end = std::min(tile_begin + TILE_ROWS, g_end);
+                unsigned block_begin = (b / g_tiles) * BLOCK_ROWS;
+                unsigned block_end = std::min(block_begin + BLOCK_ROWS, h_rows);
+
+                // Calculate the sums a tile at a time, and store them as costs
+                for (unsigned h_begin = block_begin; h_begin < block_end; h_begin += TILE_ROWS)
+                {
+                    unsigned h_end = std::min(h_begin + TILE_ROWS, block_end);
+                    tile(inputs.g_logs, tile_begin, tile_end, inputs.h_logs, h_begin, h_end, sums, TILE_ROWS);
+                    for (unsigned i = tile_begin; i < tile_end; ++i)
+                    {
+                        double *row = costs + (size_t)(i - g_begin) * h_rows;
+                        const double *sums_row = sums + (i - tile_begin) * TILE_ROWS;
+                        for (unsigned j = h_begin; j < h_end; ++j)
+                        {
+                            row[j] = cost<Term>(inputs, i, j, sums_row[j - h_begin]);
+                        }
+                    }
+                }
+            }
+        };
+        Parallel::for_chunks(g_tiles * h_blocks, 1, Parallel::resolve_threads(threads), fill_blocks);
+    }
+
+    /*
+     * The same for the metric of the given inputs, chosen once for all the tiles.
+     */
+    void fill_costs(const CostInputs &inputs, unsigned g_begin, unsigned g_end, double *costs, unsigned threads)
+    {
+        if (inputs.metric == COSINE)
+        {
+            fill_tiles<Product>(inputs, g_begin, g_end, costs, threads);
+        }
+        else
+        {
+            fill_tiles<ScaledDifference>(inputs, g_begin, g_end, costs, threads);
+        }
+    }
+
+    /*
+     * The cost of aligning node i of G with node j of H.
+     */
+    template <class Term>
+    double pair_cost(const CostInputs &inputs, unsigned i, unsigned j)
+    {
+        double sum;
+        distance_tile<Term>()(inputs.g_logs, i, i + 1, inputs.h_logs, j, j + 1, &sum, 1);
+        return cost<Term>(inputs, i, j, sum);
+    }
+
+    double pair_cost(const CostInputs &inputs, unsigned i, unsigned j)
+    {
+        return (inputs.metric == COSINE) ? pair_cost<Product>(inputs, i, j) : pair_cost<ScaledDifference>(inputs, i, j);
+    }
+
+    /*
+     * Provide the topological costs between the graphs as they are asked for, rather than all at once.
+     * Bands of rows are calculated on the given number of threads.
+     */
+    Util::CostProvider provider(const GraphCrunch::GdvMatrix &g_gdvs, const GraphCrunch::GdvMatrix &h_gdvs, double alpha,
+                                const Measure &measure, unsigned threads)
+    {
+        auto inputs = std::make_shared<const CostInputs>(cost_inputs(g_gdvs, h_gdvs, alpha, measure));
+        auto fill_rows = [inputs, threads](unsigned begin, unsigned end, double *out)
+        {
+            fill_costs(*inputs, begin, end, out, threads);
+        };
+        auto cost = [inputs](unsigned i, unsigned j)
+        {
+            return pair_cost(*inputs, i, j);
+        };
+
+        return Util::CostProvider(g_gdvs.rows, h_gdvs.rows, fill_rows, cost);
+    }
+
+    /*
+     * Candidate H nodes looked up per requested candidate, before they are ranked by their
+     * exact cost; the index only approximates the GDV distance.
+     */
+    const unsigned CANDIDATE_OVERSAMPLE = 4;
+
+    /*
+     * The signatures of a graph's nodes for the candidate index: weight(i) * ln(ln(count + 2))
+     * for orbit i, padded to LANES entries. The L1 distance between two signatures is a metric,
+     * and for nearby counts it is close to their GDV distance, as
+     * |log10(vi + 1) - log10(ui + 1)| / log10(max(vi, ui) + 2) ~ |ln(ln(vi + 2)) - ln(ln(ui + 2))|.
+     * AGREEMENT drops the weights, WEIGHTED_L1 has its distance exactly as x * scale, and
+     * COSINE uses the unit vectors, whose distance grows as their similarity falls.
+     */
+    std::vector<double> signatures(const GraphCrunch::GdvMatrix &gdvs, const CostInputs &inputs, const LogGdvs &logs)
+    {
+        std::vector<double> sigs((size_t)gdvs.rows * LANES, 0);
+        for (unsigned v = 0; v < gdvs.rows; ++v)
+        {
+            for (unsigned i = 0; i < gdvs.cols && i < 73; ++i)
+            {
+                if (!inputs.compared[i])
+                {
+                    continue;
+                }
+
+                double &sig = sigs[(size_t)v * LANES + i];
+                switch (inputs.metric)
+                {
+                case GRAAL:
+                    sig = WEIGHTS[i] * std::log(std::log(gdvs[v][i] + 2.0));
+                    break;
+                case AGREEMENT:
+                    sig = std::log(std::log(gdvs[v][i] + 2.0));
+                    break;
+                case WEIGHTED_L1:
+                    sig = logs.x_row(v)[i] * logs.scale_row(v)[i];
+                    break;
+                case COSINE:
+                    sig = logs.x_row(v)[i];
+                    break;
+                }
+            }
+        }
+
+        return sigs;
+    }
+
+    double signature_distance(const double *a, const double *b)
+    {
+        double sum = 0;
+        for (unsigned i = 0; i < LANES; ++i)
+        {
+            sum += std::abs(a[i] - b[i]);
+        }
+
+        return sum;
+    }
+
+    /*
+     * A vantage-point tree (Yianilos 1993) over a set of H node signatures. The subtree with
+     * its vantage point at items[lo] covers items[lo] .. items[hi - 1]: the nodes within
+     * radius[lo] of the vantage point are items[lo + 1] .. items[mid - 1], the rest
+     * items[mid] .. items[hi - 1], where mid = lo + 1 + (hi - lo - 1) / 2.
+     */
+    struct VpTree
+    {
+        const double *sigs = nullptr;
+        std::vector<unsigned> items;
+        std::vector<double> radius;
+    };
+
+    /*
+     * Split items[lo] .. items[hi - 1] around a vantage point, then split both halves in turn.
+     */
+    void build_vp_tree(VpTree &tree, std::vector<std::pair<double, unsigned>> &work, unsigned lo, unsigned hi)
+    {
+        if (hi - lo <= 1)
+        {
+            return;
+        }
+
+        // The middle node of the range is as good a vantage point as any, and keeps the tree repeatable
+        std::swap(work[lo], work[lo + (hi - lo) / 2]);
+        const double *vp_sig = tree.sigs + (size_t)work[lo].second * LANES;
+        for (unsigned k = lo + 1; k < hi; ++k)
+        {
+            work[k].first = signature_distance(vp_sig, tree.sigs + (size_t)work[k].second * LANES);
+        }
 
-        // Initialize the cost matrix to the right dimensions
-        std::vector<std::vector<double>> costs(g_gdvs.size(), std::vector<double>(h_gdvs.size()));
+        unsigned mid = lo + 1 + (hi - lo - 1) / 2;
+        std::nth_element(work.begin() + lo + 1, work.begin() + mid, work.begin() + hi);
+        tree.radius[lo] = (mid < hi) ? work[mid].first : 0;
 
-        // cost(g_gdvs[0], h_gdvs[1], g_max_deg, h_max_deg); // DEBUG
+        build_vp_tree(tree, work, lo + 1, mid);
+        build_vp_tree(tree, work, mid, hi);
+    }
+
+    VpTree vp_tree(const std::vector<double> &sigs, const std::vector<unsigned> &nodes)
+    {
+        VpTree tree;
+        tree.sigs = sigs.data();
+        tree.radius.assign(nodes.size(), 0);
+
+        std::vector<std::pair<double, unsigned>> work;
+        for (unsigned u : nodes)
+        {
+            work.push_back({0, u});
+        }
+        build_vp_tree(tree, work, 0, nodes.size());
+
+        for (auto &item : work)
+        {
+            tree.items.push_back(item.second);
+        }
+        return tree;
+    }
+
+    /*
+     * Collect the nearest nodes to the query in the subtree items[lo] .. items[hi - 1] into a
+     * max-heap of at most size entries, skipping the subtrees that cannot hold a nearer node.
+     */
+    void search_vp_tree(const VpTree &tree, const double *query, unsigned lo, unsigned hi, unsigned size,
+                        std::vector<std::pair<double, unsigned>> &heap)
+    {
+        if (lo >= hi || size == 0)
+        {
+            return;
+        }
 
-        // Calculate the cost matrix between G and H
-        for (unsigned i = 0; i < g_gdvs.size(); ++i)
+        unsigned vp = tree.items[lo];
+        double d = signature_distance(query, tree.sigs + (size_t)vp * LANES);
+        if (heap.size() < size || d < heap.front().first)
         {
-            for (unsigned j = 0; j < h_gdvs.size(); ++j)
+            if (heap.size() == size)
             {
-                costs[i][j] = cost(g_gdvs[i], h_gdvs[j], g_max_deg, h_max_deg);
+                std::pop_heap(heap.begin(), heap.end());
+                heap.pop_back();
             }
+            heap.push_back({d, vp});
+            std::push_heap(heap.begin(), heap.end());
         }
 
+        unsigned mid = lo + 1 + (hi - lo - 1) / 2;
+        double r = tree.radius[lo];
+        auto reach = [&]()
+        {
+            return heap.size() < size ? HUGE_VAL : heap.front().first;
+        };
+
+        // Search the side the query falls in first; the other only if the ball still reaches into it
+        if (d < r)
+        {
+            search_vp_tree(tree, query, lo + 1, mid, size, heap);
+            if (d + reach() >= r)
+            {
+                search_vp_tree(tree, query, mid, hi, size, heap);
+            }
+        }
+        else
+        {
+            search_vp_tree(tree, query, mid, hi, size, heap);
+            if (d - reach() <= r)
+            {
+                search_vp_tree(tree, query, lo + 1, mid, size, heap);
+            }
+        }
+    }
+
+    /*
+     * Calculate the topological costs of only the k most similar nodes of H for each node of G.
+     * The nodes of H are indexed by their GDV signatures in a vantage-point tree; the nearest
+     * CANDIDATE_OVERSAMPLE * k nodes in the index are then ranked by their exact cost.
+     * Aligning the nodes of highest degree in G and H lowers the cost by the degree term, so
+     * those nodes of H have an index of their own, searched for the nodes of highest degree in G.
+     */
+    Util::SparseCostMatrix candidates(const GraphCrunch::GdvMatrix &g_gdvs, const GraphCrunch::GdvMatrix &h_gdvs,
+                                      double alpha, const Measure &measure, unsigned k, unsigned threads)
+    {
+        CostInputs inputs = cost_inputs(g_gdvs, h_gdvs, alpha, measure);
+
+        // Index the nodes of H, and separately those of highest degree
+        std::vector<double> g_sigs = signatures(g_gdvs, inputs, inputs.g_logs);
+        std::vector<double> h_sigs = signatures(h_gdvs, inputs, inputs.h_logs);
+        std::vector<unsigned> h_nodes;
+        std::vector<unsigned> h_hubs;
+        for (unsigned u = 0; u < h_gdvs.rows; ++u)
+        {
+            h_nodes.push_back(u);
+            if (inputs.h_degs[u] == inputs.h_max_deg)
+            {
+                h_hubs.push_back(u);
+            }
+        }
+        VpTree tree = vp_tree(h_sigs, h_nodes);
+        VpTree hub_tree = vp_tree(h_sigs, h_hubs);
+
+        // Every node of G gets the same number of candidates
+        k = std::min(k, h_gdvs.rows);
+        unsigned size = std::min(CANDIDATE_OVERSAMPLE * k, h_gdvs.rows);
+
+        Util::SparseCostMatrix costs;
+        costs.rows = g_gdvs.rows;
+        costs.cols = h_gdvs.rows;
+        costs.offsets.resize(g_gdvs.rows + 1);
+        for (unsigned v = 0; v <= g_gdvs.rows; ++v)
+        {
+            costs.offsets[v] = (size_t)v * k;
+        }
+        costs.indices.resize((size_t)g_gdvs.rows * k);
+        costs.values.resize((size_t)g_gdvs.rows * k);
+
+        auto fill_rows = [&](unsigned, unsigned begin, unsigned end)
+        {
+            std::vector<std::pair<double, unsigned>> heap;
+            std::vector<std::pair<double, unsigned>> ranked;
+            for (unsigned v = begin; v < end; ++v)
+            {
+                const double *query = g_sigs.data() + (size_t)v * LANES;
+                heap.clear();
+                search_vp_tree(tree, query, 0, tree.items.size(), size, heap);
+                ranked.clear();
+                for (auto &item : heap)
+                {
+                    ranked.push_back({0, item.second});
+                }
+                if (inputs.g_degs[v] == inputs.g_max_deg)
+                {
+                    heap.clear();
+                    search_vp_tree(hub_tree, query, 0, hub_tree.items.size(), size, heap);
+                    for (auto &item : heap)
+                    {
+                        ranked.push_back({0, item.second});
+                    }
+                    std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b)
+                              { return a.second < b.second; });
+                    ranked.erase(std::unique(ranked.begin(), ranked.end()), ranked.end());
+                }
+
+                // Rank the candidates by their exact cost, breaking ties by node, and keep the best k
+                for (auto &item : ranked)
+                {
+                    item.first = pair_cost(inputs, v, item.second);
+                }
+                std::partial_sort(ranked.begin(), ranked.begin() + k, ranked.end());
+                std::sort(ranked.begin(), ranked.begin() + k, [](const auto &a, const auto &b)
+                          { return a.second < b.second; });
+
+                for (unsigned c = 0; c < k; ++c)
+                {
+                    costs.indices[(size_t)v * k + c] = ranked[c].second;
+                    costs.values[(size_t)v * k + c] = ranked[c].first;
+                }
+            }
+        };
+        Parallel::for_chunks(g_gdvs.rows, TILE_ROWS, Parallel::resolve_threads(threads), fill_rows);
+
         return costs;
     }
 }
@@ -24,8 +24,22 @@
  *
  *   At the end, divide out the overcount and print out how many
  *   graphlets touch at the same node class/type.
+ *
+ *   With more than one thread, the root nodes A are shared out among
+ *   workers that each keep their own counts, which are summed at the end.
+ *
+ * Alternative algorithm (EQUATIONS engine): enumerate each connected 3 and
+ *   4 node subgraph once, and get the 5 node orbits from common neighbor
+ *   counts of the 4 node subgraphs instead of enumerating them; see
+ *   count_equations.
+ *
+ * Alternative algorithm (ESU engine): enumerate each connected 3 to 5 node
+ *   subgraph exactly once, with no overcount to divide out; see count_esu.
  */
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <iostream>
 #include <stdlib.h>
 #include <stdio.h>
@@ -33,8 +47,15 @@
 #include <string>
 #include <assert.h>
 #include <map> /* STL ordered dictionary class */
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 
+#include "parallel.h"
+#include "popcount.h"
+#include "graphcrunch.h"
+
 namespace GraphCrunch
 {
     // #define PATH_MAX 256 //Oleksii
@@ -47,11 +68,11 @@ namespace GraphCrunch
      * [(sum of (degree % 4 for node/neighbors))/2][edge count/2]-4
      * Special handling needed for X23 and X25
      */
-    const char gtable[][8] =
+    constexpr char gtable[][8] =
         {{-1, -1, 10, -1, -1, 8}, {-1, 11, -1, -1, 15, 14, 12}, {17, 19, -1, 16, 18, 20}, {-1, -1, 23, 24, -1, 21}, {-1, -1, 26, 25}, {-1, -1, -1, -1, -1, -1, 27}, {28}};
 
     /* Lookup table for nodes by [graphlet][sum of degrees of node/neighbors] */
-    const char ntable[][21] =
+    constexpr char ntable[][21] =
         {{-1, -1, -1, 0, 1}, {-1, -1, -1, -1, -1, -1, 2}, {-1, -1, -1, 3, -1, 4}, {-1, -1, -1, -1, 5, -1, 6}, {-1, -1, -1, -1, -1, -1, 7}, {-1, -1, -1, -1, 8, -1, -1, 9, 10}, {-1, -1, -1, -1, -1, -1, -1, -1, 11, -1, 12}, {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 13}, {-1, -1, -1, 14, -1, 15, 16}, {-1, -1, -1, 17, 18, -1, 19, 20}, {-1, -1, -1, -1, -1, 21, -1, -1, 22}, {-1, -1, -1, -1, 23, -1, -1, -1, 24, 25}, {-1, -1, -1, 26, -1, -1, 27, 28, -1, 29}, {-1, -1, -1, -1, -1, 30, -1, -1, 31, -1, 32}, {-1, -1, -1, -1, -1, -1, 33}, {-1, -1, -1, -1, 34, -1, 35, 36, 37}, {-1, -1, -1, -1, -1, 38, -1, -1, -1, 39, -1, 40, 41}, {-1, -1, -1, -1, -1, -1, -1, -1, 42, -1, -1, -1, 43}, {-1, -1, -1, -1, 44, -1, -1, -1, 45, -1, 46, 47}, {-1, -1, -1, -1, -1, -1, -1, -1, 48, 49}, {-1, -1, -1, -1, -1, -1, -1, 50, 51, -1, 52}, {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 53, -1, -1, -1, 54}, {-1, -1, -1, -1, -1, 55, -1, -1, -1, -1, -1, -1, -1, 56, 57}, {-1, -1, -1, -1, -1, -1, -1, -1, -1, 58, -1, -1, 59, -1, 60}, {-1, -1, -1, -1, -1, -1, -1, -1, 61, -1, -1, 62, 63}, {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 64, -1, -1, -1, 65, -1, 66}, {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 67, -1, -1, 68}, {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 69, -1, -1, 70}, {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 71}};
 
     /* times counted per graphlet type */
@@ -93,153 +114,337 @@ namespace GraphCrunch
 
     typedef long long int64;
 
-    struct temp_data /* linked list of edges */
-    {
-        struct temp_data *next;
-        int dst;
-    };
-
 /* Handy macros; for details see the definition of edges_for */
 #define DEGREE(x) (edges_for[x + 1] - edges_for[x])
 #define foreach_adj(x, y) for (x = edges_for[y]; x != edges_for[y + 1]; x++)
 
-    void die(char *msg)
-    {
-        fprintf(stderr, "ERROR: %s\n", msg);
-        exit(1);
-    }
+/* Use a bit vector to store each row of the adjancency matrix, so
+ * that each edge takes up only one bit.
+ */
+#define Connect(i, j) (adjmat[i][(j) / 8] |= 1 << ((j) % 8))
 
-    std::vector<std::vector<unsigned>> count(FILE *f)
+/* The counting kernels test adjacency through the oracle adj, one of the
+ * adjacency types below. Every node counts as connected to itself.
+ */
+#define Connected(i, j) (adj.connected((i), (j)))
+
+    /*
+     * Adjacency tests against the bit vector adjacency matrix: one load per test, but
+     * V * (V / 8 + 1) bytes of memory. Each row is stored in whole 64-bit words, so that rows
+     * can also be intersected a word at a time.
+     */
+    struct BitAdjacency
     {
-        int V;
-        int E;
-        int E_undir;
-        int i;
-        int j;
+        static constexpr bool ROWS = true;
 
-        fscanf(f, "%d", &V);
-        fscanf(f, "%d", &E_undir);
-        E = E_undir * 2;
-        V++; // nodes are numbered from 1 to V
+        char *const *adjmat;
+        unsigned words; /* 64-bit words per row */
 
-        assert(E_undir >= 0);
+        bool connected(int i, int j) const
+        {
+            return adjmat[i][j / 8] & (1 << (j % 8));
+        }
 
-        struct temp_data **heads = new temp_data *[V]; // Oleksii
-        struct temp_data *links = new temp_data[E];    // Oleksii
-        for (i = 0; i < V; i++)
-            heads[i] = NULL;
+        const unsigned long long *row(int i) const
+        {
+            return reinterpret_cast<const unsigned long long *>(adjmat[i]);
+        }
+    };
 
-        struct temp_data *link;
+    /*
+     * Adjacency tests against an open addressing hash set of the edges, each stored once as
+     * (smaller node, larger node): one or two probes per test, and memory proportional to E.
+     */
+    struct HashAdjacency
+    {
+        static constexpr bool ROWS = false;
 
-        /* allocate some space for the adjacency matrix */
-        char **adjmat = new char *[V]; // Oleksii
-/* Use a bit vector to store each row of the adjancency matrix, so
- * that each edge takes up only one bit.
- */
-#define Connect(i, j) (adjmat[i][(j) / 8] |= 1 << ((j) % 8))
-#define Connected(i, j) (adjmat[i][(j) / 8] & (1 << ((j) % 8)))
-        for (i = 0; i < V; i++)
+        const unsigned long long *slots; /* EMPTY_SLOT or (i << 32 | j), i < j */
+        unsigned long long mask;         /* number of slots - 1, a power of 2 minus 1 */
+
+        static constexpr unsigned long long EMPTY_SLOT = ~0ULL;
+
+        static unsigned long long slot(unsigned long long key, unsigned long long mask)
+        {
+            return (key * 0x9E3779B97F4A7C15ULL >> 20) & mask;
+        }
+
+        bool connected(int i, int j) const
         {
-            /* calloc zeroes the memory for us */
-            adjmat[i] = (char *)calloc(V / 8 + 1, sizeof(char));
-            if (!adjmat[i])
+            if (i == j)
+                return true;
+            if (i > j)
+                std::swap(i, j);
+
+            unsigned long long key = (unsigned long long)i << 32 | (unsigned)j;
+            for (unsigned long long s = slot(key, mask);; s = (s + 1) & mask)
             {
-                perror("calloc");
-                exit(1);
+                if (slots[s] == key)
+                    return true;
+                if (slots[s] == EMPTY_SLOT)
+                    return false;
             }
+        }
+    };
+
+    /*
+     * Fill a hash set of the edges of the given graph, at most half full.
+     */
+    HashAdjacency hash_edges(const CsrGraph &graph, std::vector<unsigned long long> &slots)
+    {
+        unsigned long long size = 2;
+        while (size < graph.adj.size() + 2)
+            size *= 2;
+
+        slots.assign(size, HashAdjacency::EMPTY_SLOT);
+        HashAdjacency adj{slots.data(), size - 1};
+
+        for (int i = 0; i < graph.V; i++)
+        {
+            for (int k = graph.offsets[i]; k < graph.offsets[i + 1]; k++)
+            {
+                int j = graph.adj[k];
+                if (j < i)
+                    continue;
 
-            Connect(i, i); /* optimization hack */
+                unsigned long long key = (unsigned long long)i << 32 | (unsigned)j;
+                unsigned long long s = HashAdjacency::slot(key, adj.mask);
+                while (slots[s] != HashAdjacency::EMPTY_SLOT)
+                    s = (s + 1) & adj.mask;
+                slots[s] = key;
+            }
         }
 
-        /* First stores edges in linked lists by node (vertex) so we know how many
-         * edges there are for each node, then copy to an array for efficiency.
-         */
+        return adj;
+    }
+
+    /* The bit vector adjacency matrix is used when it takes at most ADJMAT_MAX_BYTES. The brute
+     * force enumeration always uses it then; the equations and ESU engines, which test far fewer
+     * pairs, only use it if it takes at most ADJMAT_SMALL_BYTES (small enough that its rows stay
+     * in cache) or the graph has an average degree of at least ADJMAT_MIN_DEGREE. Otherwise the
+     * edge hash set is used.
+     */
+    const double ADJMAT_MAX_BYTES = 1 << 30;
+    const double ADJMAT_SMALL_BYTES = 1 << 24;
+    const double ADJMAT_MIN_DEGREE = 64;
+
+    /* The triangle, 4-cycle, diamond and K4 orbits are counted from intersections of adjacency
+     * matrix rows (see count_row_orbits) when the graph has at least ROW_ORBITS_MIN_FILL edges
+     * per node for every 64-bit word of a row; sparser rows are mostly zero words.
+     */
+    const double ROW_ORBITS_MIN_FILL = 1;
+
+    /* Root nodes handed to a worker at a time in the parallel counting mode */
+    const unsigned ROOT_CHUNK = 16;
+
+    /* Every worker past the first keeps private node type counts, 72 x V 64-bit counts (twice
+     * that when sampling); the workers are capped so that these take at most WORKER_COUNTS_MAX_BYTES.
+     */
+    const double WORKER_COUNTS_MAX_BYTES = 1 << 30;
+
+    void die(char *msg)
+    {
+        fprintf(stderr, "ERROR: %s\n", msg);
+        exit(1);
+    }
+
+    /* 5 NODE GRAPHLET CLASSIFICATION */
+
+    /* Bit of the edge mask for the node pair (i, j), i < j. Masks of the first k nodes of a
+     * subgraph are the low k(k-1)/2 bits of the masks of larger subgraphs.
+     */
+#define PAIR_BIT(i, j) (1 << ((j) * ((j) - 1) / 2 + (i)))
 
-        /* add data to linked list for intermediate storage */
-        for (i = 0; i < E_undir; i++)
+    /*
+     * Whether the subgraph of the first k nodes with the given edge mask is connected,
+     * ignoring the node skip (pass -1 to ignore none).
+     */
+    constexpr bool mask_connected(int mask, int k, int skip)
+    {
+        int seen = 0;
+        int start = (skip == 0) ? 1 : 0;
+        int stack[5];
+        int top = 0;
+
+        stack[top++] = start;
+        seen |= 1 << start;
+        while (top > 0)
         {
-            int src = -1;
-            int dst = -1;
-            fscanf(f, "%d %d", &src, &dst);
-            assert(src < V && dst < V);
+            int u = stack[--top];
+            for (int v = 0; v < k; v++)
+            {
+                if (v == skip || v == u || (seen & (1 << v)))
+                    continue;
+                if (mask & (u < v ? PAIR_BIT(u, v) : PAIR_BIT(v, u)))
+                {
+                    seen |= 1 << v;
+                    stack[top++] = v;
+                }
+            }
+        }
 
-            if (src < 0 || dst < 0)
+        int want = (1 << k) - 1;
+        if (skip >= 0)
+            want &= ~(1 << skip);
+        return seen == want;
+    }
+
+    /*
+     * Classify the nodes of a connected 5 node mask by their degrees, the degrees of their
+     * neighbors, and the gtable/ntable lookup tables, and return the graphlet type.
+     */
+    constexpr int classify5(int mask, signed char *types)
+    {
+        int deg[5] = {};
+        int adj[5][5] = {};
+        for (int j = 1; j < 5; j++)
+        {
+            for (int i = 0; i < j; i++)
             {
-                fprintf(stderr, "Error: node numbers must be greater than zero.\n");
-                exit(1);
+                if (mask & PAIR_BIT(i, j))
+                {
+                    adj[i][j] = adj[j][i] = 1;
+                    deg[i]++;
+                    deg[j]++;
+                }
             }
+        }
 
-            if (src == dst)
-                continue; /* ignore self-loops */
+        int sorted[5];
+        std::copy(deg, deg + 5, sorted);
+        std::sort(sorted, sorted + 5);
 
-            /* See if edge is already in list */
-            int bad = 0;
-            for (link = heads[src]; link; link = link->next)
+        /* The three graphlets without a hamiltonian path are found from claws and flowers */
+        if (sorted[4] == 3 && sorted[3] == 2 && sorted[0] == 1 && sorted[2] == 1) /* X10 */
+        {
+            for (int i = 0; i < 5; i++)
             {
-                if (link->dst == dst)
+                if (deg[i] == 3)
+                    types[i] = X10_D;
+                else if (deg[i] == 2)
+                    types[i] = X10_C;
+                else
                 {
-                    bad = 1; /* don't allow parallel edges */
-                    break;
+                    int nbr = 0;
+                    while (!adj[i][nbr])
+                        nbr++;
+                    types[i] = (deg[nbr] == 3) ? X10_B : X10_A;
                 }
             }
-            if (bad)
-                continue;
+            return 9;
+        }
+        if (sorted[4] == 4 && sorted[3] == 1) /* X11 */
+        {
+            for (int i = 0; i < 5; i++)
+                types[i] = (deg[i] == 4) ? X11_B : X11_A;
+            return 10;
+        }
+        if (sorted[4] == 4 && sorted[3] == 2 && sorted[1] == 1) /* X14 */
+        {
+            for (int i = 0; i < 5; i++)
+                types[i] = (deg[i] == 4) ? X14_C : (deg[i] == 2) ? X14_B : X14_A;
+            return 13;
+        }
+
+        int ndeg[5];
+        int hash = 0;
+        int deg_total = 0;
+        for (int i = 0; i < 5; i++)
+        {
+            ndeg[i] = deg[i];
+            for (int j = 0; j < 5; j++)
+            {
+                if (adj[i][j])
+                    ndeg[i] += deg[j];
+            }
+            hash += ndeg[i] % 4;
+            deg_total += deg[i];
+        }
 
-            struct temp_data *ntemp1 = &links[i * 2];
-            struct temp_data *ntemp2 = &links[i * 2 + 1];
+        int gtype = gtable[deg_total / 2 - 4][hash / 2];
 
-            /* Add to front of node's linked list */
-            ntemp1->next = heads[src];
-            ntemp1->dst = dst;
-            ntemp2->next = heads[dst];
-            ntemp2->dst = src;
-            heads[src] = ntemp1;
-            heads[dst] = ntemp2;
+        /* X23 and X25 are told apart by the end node of a hamiltonian path */
+        if (deg_total == 14 && hash == 6)
+        {
+            int path[5] = {0, 1, 2, 3, 4};
+            do
+            {
+                if (adj[path[0]][path[1]] && adj[path[1]][path[2]] && adj[path[2]][path[3]] && adj[path[3]][path[4]])
+                    break;
+            } while (std::next_permutation(path, path + 5));
 
-            Connect(src, dst);
-            Connect(dst, src);
+            int ndeg_a = ndeg[path[0]];
+            gtype = (ndeg_a > 12 || ndeg_a == 5) ? 22 : 24;
         }
 
-        /* The edges[] array stores edges by node sequentially, so the last edge
-        of node n is followed by the first edge of n+1. edges_for[] stores
-        a pointer to the first edge of a node. */
+        assert(gtype > 7 && gtype < 29);
 
-        int **edges_for = new int *[V + 1]; // Oleksii
-        int *edges = new int[E * 2 + 1];    // Oleksii
+        for (int i = 0; i < 5; i++)
+            types[i] = ntable[gtype][ndeg[i]];
+        return gtype;
+    }
 
-        int *edge_last = &edges[0];
+    /*
+     * The graphlet type and the node type of each node of a 5 node subgraph, by edge mask;
+     * all -1 if the mask is not connected. Eight bytes, so that an entry is a single load.
+     */
+    struct alignas(8) Graphlet5
+    {
+        signed char gtype;
+        signed char types[5];
+    };
 
-        for (i = 0; i < V; i++)
+    constexpr std::array<Graphlet5, 1 << 10> make_graphlets5()
+    {
+        std::array<Graphlet5, 1 << 10> graphlets{};
+        for (int mask = 0; mask < (1 << 10); mask++)
         {
-            edges_for[i] = edge_last;
-            for (link = heads[i]; link; link = link->next)
-            {
-                *edge_last = link->dst;
-                edge_last++;
-            }
+            Graphlet5 &g = graphlets[mask];
+            g.gtype = -1;
+            for (int i = 0; i < 5; i++)
+                g.types[i] = -1;
+            if (mask_connected(mask, 5, -1))
+                g.gtype = classify5(mask, g.types);
         }
-        edges_for[i] = edge_last;
+        return graphlets;
+    }
 
-        int64 gcount[29] = {};
-        int64 *ncount[72];
+    constexpr std::array<Graphlet5, 1 << 10> graphlets5 = make_graphlets5();
 
-        /* allocate space for node type counts */
-        for (i = 0; i < 72; i++)
+    /* For every node of a connected 5 node mask, the number of other nodes whose removal
+     * leaves the remaining 4 nodes connected.
+     */
+    constexpr std::array<std::array<unsigned char, 5>, 1 << 10> make_nremovable5()
+    {
+        std::array<std::array<unsigned char, 5>, 1 << 10> nremovable{};
+        for (int mask = 0; mask < (1 << 10); mask++)
         {
-            ncount[i] = (int64 *)calloc(V, sizeof(int64));
-            if (!ncount[i])
-            {
-                perror("calloc");
-                exit(1);
-            }
+            if (!mask_connected(mask, 5, -1))
+                continue;
+            for (int i = 0; i < 5; i++)
+                for (int j = 0; j < 5; j++)
+                    if (j != i && mask_connected(mask, 5, j))
+                        nremovable[mask][i]++;
         }
+        return nremovable;
+    }
 
-        /* start counting */
+    constexpr std::array<std::array<unsigned char, 5>, 1 << 10> nremovable5 = make_nremovable5();
 
-        int *pb, *pc, *pd, *pe;
+    /*
+     * Count the graphlets rooted at nodes a_begin..a_end-1 (every path or claw whose first node is
+     * in the range), accumulating into the given graphlet and node type counts. Only graphlets of
+     * up to GS nodes are counted; the enumeration levels for larger ones are compiled out. With
+     * ROW_ORBITS the triangle, 4-cycle, diamond and K4 node types are left to count_row_orbits.
+     */
+    template <int GS, bool ROW_ORBITS, class Adjacency>
+    void count_roots(int a_begin, int a_end, const int *const *edges_for, const Adjacency &adj,
+                     int64 *gcount, int64 *const *ncount)
+    {
+        const int *pb, *pc, *pd, *pe;
         int a, b, c, d, e, x;
 
-        for (a = 0; a < V; a++)
+        for (a = a_begin; a < a_end; a++)
         {
 
             foreach_adj(pb, a)
@@ -276,292 +481,1550 @@ namespace GraphCrunch
                         ncount[P3_A][c]++;
 
                         // look for claws
-                        if (DEGREE(b) > 2)
-                            foreach_adj(pd, b)
-                            {
-                                d = *pd;
-                                if (Connected(a, d) + Connected(c, d) == 0)
+                        if constexpr (GS >= 4)
+                        {
+                            if (DEGREE(b) > 2)
+                                foreach_adj(pd, b)
                                 {
-                                    // look for X11
-                                    if (DEGREE(b) > 3)
-                                        foreach_adj(pe, b)
+                                    d = *pd;
+                                    if (Connected(a, d) + Connected(c, d) == 0)
+                                    {
+                                        // look for X11
+                                        if constexpr (GS >= 5)
                                         {
-                                            e = *pe;
-                                            if (Connected(a, e) + Connected(c, e) + Connected(d, e) == 0)
-                                            {
-                                                gcount[10]++; /* X11 */
-                                                ncount[X11_A][a]++;
-                                                ncount[X11_B][b]++;
-                                                ncount[X11_A][c]++;
-                                                ncount[X11_A][d]++;
-                                                ncount[X11_A][e]++;
-                                            }
+                                            if (DEGREE(b) > 3)
+                                                foreach_adj(pe, b)
+                                                {
+                                                    e = *pe;
+                                                    if (Connected(a, e) + Connected(c, e) + Connected(d, e) == 0)
+                                                    {
+                                                        gcount[10]++; /* X11 */
+                                                        ncount[X11_A][a]++;
+                                                        ncount[X11_B][b]++;
+                                                        ncount[X11_A][c]++;
+                                                        ncount[X11_A][d]++;
+                                                        ncount[X11_A][e]++;
+                                                    }
+                                                }
                                         }
 
-                                    gcount[3]++; /* Claw! */
-                                    ncount[CLAW_A][a]++;
-                                    ncount[CLAW_B][b]++;
-                                    ncount[CLAW_A][c]++;
-                                    ncount[CLAW_A][d]++;
+                                        gcount[3]++; /* Claw! */
+                                        ncount[CLAW_A][a]++;
+                                        ncount[CLAW_B][b]++;
+                                        ncount[CLAW_A][c]++;
+                                        ncount[CLAW_A][d]++;
+                                    }
                                 }
-                            }
+                        }
                     }
                     else
                     {
                         gcount[1]++; /* triangle */
-                        ncount[C3_A][a]++;
-                        ncount[C3_A][b]++;
-                        ncount[C3_A][c]++;
+                        if constexpr (!ROW_ORBITS)
+                        {
+                            ncount[C3_A][a]++;
+                            ncount[C3_A][b]++;
+                            ncount[C3_A][c]++;
+                        }
                     }
 
-                    foreach_adj(pd, c)
+                    if constexpr (GS >= 4)
                     {
-                        d = *pd;
-                        if (d == a || d == b || d == c)
+                        foreach_adj(pd, c)
                         {
-                            continue;
-                        }
+                            d = *pd;
+                            if (d == a || d == b || d == c)
+                            {
+                                continue;
+                            }
 
-                        /* classify most 4-node graphlets (excluding some claws) */
+                            /* classify most 4-node graphlets (excluding some claws) */
 
-                        int deg4_a = deg3_a, deg4_b = deg3_b, deg4_c = deg3_c, deg4_d = 0;
+                            int deg4_a = deg3_a, deg4_b = deg3_b, deg4_c = deg3_c, deg4_d = 0;
 
-                        x = !!Connected(a, d);
-                        deg4_d += x;
-                        deg4_a += x;
-                        x = !!Connected(b, d);
-                        deg4_d += x;
-                        deg4_b += x;
-                        x = !!Connected(c, d);
-                        deg4_d += x;
-                        deg4_c += x;
+                            x = !!Connected(a, d);
+                            deg4_d += x;
+                            deg4_a += x;
+                            x = !!Connected(b, d);
+                            deg4_d += x;
+                            deg4_b += x;
+                            x = !!Connected(c, d);
+                            deg4_d += x;
+                            deg4_c += x;
 
-                        int num_edges = deg4_a + deg4_b + deg4_c + deg4_d;
+                            int num_edges = deg4_a + deg4_b + deg4_c + deg4_d;
+                            int mask4 = PAIR_BIT(0, 1) | ((deg3_a - 1) << 1) | PAIR_BIT(1, 2) |
+                                        ((deg4_a - deg3_a) << 3) | ((deg4_b - deg3_b) << 4) | PAIR_BIT(2, 3);
 
-                        if (num_edges == 6)
-                        {
-                            gcount[2]++; /* P4 */
-                            ncount[P4_A][a]++;
-                            ncount[P4_B][b]++;
-                            ncount[P4_B][c]++;
-                            ncount[P4_A][d]++;
+                            if (num_edges == 6)
+                            {
+                                gcount[2]++; /* P4 */
+                                ncount[P4_A][a]++;
+                                ncount[P4_B][b]++;
+                                ncount[P4_B][c]++;
+                                ncount[P4_A][d]++;
 
-                            foreach_adj(pe, b) /* look for X10 */
+                                if constexpr (GS >= 5)
+                                {
+                                    foreach_adj(pe, b) /* look for X10 */
+                                    {
+                                        e = *pe;
+                                        if (Connected(a, e) + Connected(c, e) + Connected(d, e) == 0)
+                                        {
+                                            gcount[9]++; /* X10 */
+                                            ncount[X10_B][a]++;
+                                            ncount[X10_D][b]++;
+                                            ncount[X10_C][c]++;
+                                            ncount[X10_A][d]++;
+                                            ncount[X10_B][e]++;
+                                        }
+                                    }
+                                }
+                            }
+                            else if (num_edges == 10)
                             {
-                                e = *pe;
-                                if (Connected(a, e) + Connected(c, e) + Connected(d, e) == 0)
+                                gcount[6]++; /* Diamond */
+                                if constexpr (!ROW_ORBITS)
                                 {
-                                    gcount[9]++; /* X10 */
-                                    ncount[X10_B][a]++;
-                                    ncount[X10_D][b]++;
-                                    ncount[X10_C][c]++;
-                                    ncount[X10_A][d]++;
-                                    ncount[X10_B][e]++;
+                                    ncount[deg4_a == 3 ? DIAM_B : DIAM_A][a]++;
+                                    ncount[deg4_b == 3 ? DIAM_B : DIAM_A][b]++;
+                                    ncount[deg4_c == 3 ? DIAM_B : DIAM_A][c]++;
+                                    ncount[deg4_d == 3 ? DIAM_B : DIAM_A][d]++;
                                 }
                             }
-                        }
-                        else if (num_edges == 10)
-                        {
-                            gcount[6]++; /* Diamond */
-                            ncount[deg4_a == 3 ? DIAM_B : DIAM_A][a]++;
-                            ncount[deg4_b == 3 ? DIAM_B : DIAM_A][b]++;
-                            ncount[deg4_c == 3 ? DIAM_B : DIAM_A][c]++;
-                            ncount[deg4_d == 3 ? DIAM_B : DIAM_A][d]++;
-                        }
-                        else if (num_edges == 12)
-                        {
-                            gcount[7]++; /* K4 */
-                            ncount[K4_A][a]++;
-                            ncount[K4_A][b]++;
-                            ncount[K4_A][c]++;
-                            ncount[K4_A][d]++;
-                        }
-                        else if (num_edges == 8) /* C4 or Flower */
-                        {
-                            if (deg4_b == 3 || deg4_c == 3)
+                            else if (num_edges == 12)
                             {
-                                gcount[5]++; /* Flower */
-                                if (deg4_b == 3)
+                                gcount[7]++; /* K4 */
+                                if constexpr (!ROW_ORBITS)
                                 {
-                                    ncount[FLOW_A][a]++;
-                                    ncount[FLOW_C][b]++;
-                                    ncount[FLOW_B][c]++;
-                                    ncount[FLOW_B][d]++;
-
-                                    // only do this for half the cases, to reduce overcount
-                                    foreach_adj(pe, b)
+                                    ncount[K4_A][a]++;
+                                    ncount[K4_A][b]++;
+                                    ncount[K4_A][c]++;
+                                    ncount[K4_A][d]++;
+                                }
+                            }
+                            else if (num_edges == 8) /* C4 or Flower */
+                            {
+                                if (deg4_b == 3 || deg4_c == 3)
+                                {
+                                    gcount[5]++; /* Flower */
+                                    if (deg4_b == 3)
                                     {
-                                        e = *pe;
-                                        if (Connected(a, e) + Connected(c, e) + Connected(d, e) == 0)
+                                        ncount[FLOW_A][a]++;
+                                        ncount[FLOW_C][b]++;
+                                        ncount[FLOW_B][c]++;
+                                        ncount[FLOW_B][d]++;
+
+                                        if constexpr (GS >= 5)
                                         {
-                                            gcount[13]++; /* X14 */
-                                            ncount[X14_A][a]++;
-                                            ncount[X14_C][b]++;
-                                            ncount[X14_B][c]++;
-                                            ncount[X14_B][d]++;
-                                            ncount[X14_A][e]++;
+                                            // only do this for half the cases, to reduce overcount
+                                            foreach_adj(pe, b)
+                                            {
+                                                e = *pe;
+                                                if (Connected(a, e) + Connected(c, e) + Connected(d, e) == 0)
+                                                {
+                                                    gcount[13]++; /* X14 */
+                                                    ncount[X14_A][a]++;
+                                                    ncount[X14_C][b]++;
+                                                    ncount[X14_B][c]++;
+                                                    ncount[X14_B][d]++;
+                                                    ncount[X14_A][e]++;
+                                                }
+                                            }
                                         }
                                     }
+                                    else
+                                    {
+                                        ncount[FLOW_B][a]++;
+                                        ncount[FLOW_B][b]++;
+                                        ncount[FLOW_C][c]++;
+                                        ncount[FLOW_A][d]++;
+                                    }
                                 }
                                 else
                                 {
-                                    ncount[FLOW_B][a]++;
-                                    ncount[FLOW_B][b]++;
-                                    ncount[FLOW_C][c]++;
-                                    ncount[FLOW_A][d]++;
+                                    gcount[4]++; /* C4 */
+                                    if constexpr (!ROW_ORBITS)
+                                    {
+                                        ncount[C4_A][a]++;
+                                        ncount[C4_A][b]++;
+                                        ncount[C4_A][c]++;
+                                        ncount[C4_A][d]++;
+                                    }
                                 }
                             }
-                            else
+
+                            if constexpr (GS >= 5)
                             {
-                                gcount[4]++; /* C4 */
-                                ncount[C4_A][a]++;
-                                ncount[C4_A][b]++;
-                                ncount[C4_A][c]++;
-                                ncount[C4_A][d]++;
+                                /* classify most 5-node graphlets */
+                                foreach_adj(pe, d)
+                                {
+                                    e = *pe;
+                                    if (e == a || e == b || e == c || e == d)
+                                    {
+                                        continue;
+                                    }
+
+                                    /* the edges a-b, b-c, c-d and d-e are on the path */
+                                    int mask5 = mask4 | (Connected(a, e) << 6) | (Connected(b, e) << 7) |
+                                                (Connected(c, e) << 8) | PAIR_BIT(3, 4);
+                                    Graphlet5 graphlet = graphlets5[mask5];
+
+                                    assert(graphlet.gtype > 7 && graphlet.gtype < 29);
+
+                                    gcount[graphlet.gtype]++;
+
+                                    ncount[graphlet.types[0]][a]++;
+                                    ncount[graphlet.types[1]][b]++;
+                                    ncount[graphlet.types[2]][c]++;
+                                    ncount[graphlet.types[3]][d]++;
+                                    ncount[graphlet.types[4]][e]++;
+                                }
                             }
                         }
+                    }
+                }
+            }
+        }
+    }
 
-                        /* classify most 5-node graphlets */
-                        foreach_adj(pe, d)
-                        {
-                            e = *pe;
-                            if (e == a || e == b || e == c || e == d)
-                            {
-                                continue;
-                            }
+    /*
+     * Count the triangle, 4-cycle, diamond and K4 orbits of nodes a_begin..a_end-1 from the
+     * number of bits in intersections of adjacency matrix rows, instead of enumerating paths.
+     * With c(x, y) the number of common neighbors of x and y, and c(x, y, z) of x, y and z:
+     *
+     *   C3_A(x)   = sum over neighbors y of c(x, y), / 2
+     *   K4_A(x)   = sum over edges y-z between neighbors of x of c(x, y, z), / 3
+     *   DIAM_B(x) = sum over neighbors y of C(c(x, y), 2), - 3 K4_A(x)
+     *   DIAM_A(x) = sum over edges y-z between neighbors of x of (c(y, z) - 1), - 3 K4_A(x)
+     *   C4_A(x)   = sum over nodes w != x of C(c(x, w), 2), - DIAM_A(x) - DIAM_B(x) - 3 K4_A(x)
+     *
+     * When only 3 node graphlets are counted the path orbits follow as well, so that no
+     * enumeration is needed at all:
+     *
+     *   P3_B(x)   = C(deg(x), 2) - C3_A(x)
+     *   P3_A(x)   = sum over neighbors y of (deg(y) - 1), - 2 C3_A(x)
+     *
+     * The rows have the diagonal bit set, so an intersection of adjacent nodes' rows also has
+     * the bits of the nodes themselves. The counts are exact (no overcount). common is scratch
+     * space of V zeros, the caller's to reuse across calls; it is left zeroed.
+     */
+    template <int GS>
+    void count_row_orbits(int a_begin, int a_end, int V, const int *const *edges_for, const BitAdjacency &adj,
+                          int64 *const *ncount, int *common)
+    {
+        const Popcount::Kernels &kernels = Popcount::kernels();
+        std::vector<int> reached;
+        const int *py, *pz, *pw;
 
-                            int deg5_a = deg4_a, deg5_b = deg4_b, deg5_c = deg4_c,
-                                deg5_d = deg4_d, deg5_e = 0;
-
-                            x = !!Connected(e, a);
-                            deg5_e += x;
-                            deg5_a += x;
-                            x = !!Connected(e, b);
-                            deg5_e += x;
-                            deg5_b += x;
-                            x = !!Connected(e, c);
-                            deg5_e += x;
-                            deg5_c += x;
-                            x = !!Connected(e, d);
-                            deg5_e += x;
-                            deg5_d += x;
-
-                            /* add degrees of node and neighbors to find each ndeg */
-                            int ndeg_a = deg5_a;
-                            int ndeg_b = deg5_b;
-                            int ndeg_c = deg5_c;
-                            int ndeg_d = deg5_d;
-                            int ndeg_e = deg5_e;
-                            if (Connected(a, b))
-                            {
-                                ndeg_a += deg5_b;
-                                ndeg_b += deg5_a;
-                            }
-                            if (Connected(a, c))
-                            {
-                                ndeg_a += deg5_c;
-                                ndeg_c += deg5_a;
-                            }
-                            if (Connected(a, d))
-                            {
-                                ndeg_a += deg5_d;
-                                ndeg_d += deg5_a;
-                            }
-                            if (Connected(a, e))
-                            {
-                                ndeg_a += deg5_e;
-                                ndeg_e += deg5_a;
-                            }
-                            if (Connected(b, c))
-                            {
-                                ndeg_b += deg5_c;
-                                ndeg_c += deg5_b;
-                            }
-                            if (Connected(b, d))
-                            {
-                                ndeg_b += deg5_d;
-                                ndeg_d += deg5_b;
-                            }
-                            if (Connected(b, e))
-                            {
-                                ndeg_b += deg5_e;
-                                ndeg_e += deg5_b;
-                            }
-                            if (Connected(c, d))
-                            {
-                                ndeg_c += deg5_d;
-                                ndeg_d += deg5_c;
-                            }
-                            if (Connected(c, e))
-                            {
-                                ndeg_c += deg5_e;
-                                ndeg_e += deg5_c;
-                            }
-                            if (Connected(d, e))
-                            {
-                                ndeg_d += deg5_e;
-                                ndeg_e += deg5_d;
-                            }
+        for (int x = a_begin; x < a_end; x++)
+        {
+            const unsigned long long *row_x = adj.row(x);
+            int64 triangles2 = 0;   /* twice the triangles on x */
+            int64 common_pairs = 0; /* sum of C(c(x, y), 2) */
+            int64 cliques3 = 0;     /* three times the K4s on x */
+            int64 edge_common = 0;  /* sum of c(y, z) - 1 */
+            int64 wedges = 0;       /* paths x-y-w */
+
+            foreach_adj(py, x)
+            {
+                int y = *py;
+                const unsigned long long *row_y = adj.row(y);
+                int64 c = (int64)kernels.and_count(row_x, row_y, adj.words) - 2;
+
+                triangles2 += c;
+                common_pairs += c * (c - 1) / 2;
+                wedges += DEGREE(y);
 
-                            // note that (x%4 + y%4) is not the same as (x+y)%4
-                            int hash = (ndeg_a % 4 + ndeg_b % 4 + ndeg_c % 4 + ndeg_d % 4 + ndeg_e % 4);
-                            int deg_total = deg5_a + deg5_b + deg5_c + deg5_d + deg5_e;
-                            int gtype = gtable[deg_total / 2 - 4][hash / 2];
+                if constexpr (GS >= 4)
+                {
+                    foreach_adj(pz, y)
+                    {
+                        int z = *pz;
+                        if (z <= y || z == x || !Connected(x, z))
+                            continue;
 
-                            /* not caught by table */
-                            if (deg_total == 14 && hash == 6)
-                                gtype = (ndeg_a > 12 || ndeg_a == 5) ? 22 : 24;
+                        const unsigned long long *row_z = adj.row(z);
+                        cliques3 += (int64)kernels.and3_count(row_x, row_y, row_z, adj.words) - 3;
+                        edge_common += (int64)kernels.and_count(row_y, row_z, adj.words) - 3;
+                    }
+                }
+            }
 
-                            assert(gtype > 7 && gtype < 29);
+            ncount[C3_A][x] += triangles2 / 2;
 
-                            gcount[gtype]++;
+            if constexpr (GS == 3)
+            {
+                int64 degree = DEGREE(x);
+                ncount[P3_B][x] += degree * (degree - 1) / 2 - triangles2 / 2;
+                ncount[P3_A][x] += wedges - degree - triangles2;
+            }
 
-                            ncount[(int)ntable[gtype][ndeg_a]][a]++;
-                            ncount[(int)ntable[gtype][ndeg_b]][b]++;
-                            ncount[(int)ntable[gtype][ndeg_c]][c]++;
-                            ncount[(int)ntable[gtype][ndeg_d]][d]++;
-                            ncount[(int)ntable[gtype][ndeg_e]][e]++;
+            if constexpr (GS >= 4)
+            {
+                int64 k4 = cliques3 / 3;
+                int64 diam_a = edge_common - 3 * k4;
+                int64 diam_b = common_pairs - 3 * k4;
+
+                /* Sum C(c(x, w), 2) over all w, from the rows when that takes fewer words than
+                 * there are paths x-y-w to count w by */
+                int64 common_quads = 0;
+                if (wedges > (int64)V * adj.words)
+                {
+                    for (int w = 0; w < V; w++)
+                    {
+                        if (w == x)
+                            continue;
+                        int64 c = (int64)kernels.and_count(row_x, adj.row(w), adj.words) - (Connected(x, w) ? 2 : 0);
+                        common_quads += c * (c - 1) / 2;
+                    }
+                }
+                else
+                {
+                    foreach_adj(py, x)
+                    {
+                        foreach_adj(pw, *py)
+                        {
+                            if (*pw == x)
+                                continue;
+                            if (common[*pw]++ == 0)
+                                reached.push_back(*pw);
                         }
                     }
+                    for (int w : reached)
+                    {
+                        common_quads += (int64)common[w] * (common[w] - 1) / 2;
+                        common[w] = 0;
+                    }
+                    reached.clear();
                 }
+
+                ncount[K4_A][x] += k4;
+                ncount[DIAM_A][x] += diam_a;
+                ncount[DIAM_B][x] += diam_b;
+                ncount[C4_A][x] += common_quads - diam_a - diam_b - 3 * k4;
             }
         }
+    }
 
-        /* output */
-        std::vector<std::vector<unsigned>> gdvs;
+    /* ORBIT EQUATIONS ENGINE */
 
-        for (j = 1; j < V; j++)
+    /* Node types by edge mask for connected induced subgraphs of 3 and 4 nodes,
+     * -1 if the mask is not connected.
+     */
+    constexpr std::array<std::array<signed char, 3>, 1 << 3> make_ntype3()
+    {
+        std::array<std::array<signed char, 3>, 1 << 3> ntype{};
+        for (int mask = 0; mask < (1 << 3); mask++)
         {
-            std::vector<unsigned> gdv;
-
-            gdv.push_back(DEGREE(j));
+            for (int i = 0; i < 3; i++)
+                ntype[mask][i] = -1;
+            if (!mask_connected(mask, 3, -1))
+                continue;
 
-            for (i = 0; i < 72; i++)
+            for (int i = 0; i < 3; i++)
             {
-                gdv.push_back((unsigned)ncount[i][j] / overcount[ntype2gtype[i]]);
+                if (mask == 7)
+                    ntype[mask][i] = C3_A;
+                else
+                {
+                    int deg = 0;
+                    for (int j = 0; j < 3; j++)
+                        if (j != i && (mask & (i < j ? PAIR_BIT(i, j) : PAIR_BIT(j, i))))
+                            deg++;
+                    ntype[mask][i] = (deg == 2) ? P3_B : P3_A;
+                }
             }
-            gdvs.push_back(gdv);
         }
-
-        return gdvs;
+        return ntype;
     }
 
-    std::vector<std::vector<unsigned>> graphcrunch(std::string in_file_str)
+    constexpr std::array<std::array<signed char, 4>, 1 << 6> make_ntype4()
     {
-        const char *in_file = in_file_str.c_str();
-
-        FILE *fp = fopen(in_file, "r");
-        if (!fp)
+        std::array<std::array<signed char, 4>, 1 << 6> ntype{};
+        for (int mask = 0; mask < (1 << 6); mask++)
         {
-            perror(in_file);
-            exit(1);
-        }
+            for (int i = 0; i < 4; i++)
+                ntype[mask][i] = -1;
+            if (!mask_connected(mask, 4, -1))
+                continue;
 
-        std::vector<std::vector<unsigned>> gdvs = count(fp);
+            int deg[4] = {};
+            int num_edges = 0;
+            for (int j = 1; j < 4; j++)
+            {
+                for (int i = 0; i < j; i++)
+                {
+                    if (mask & PAIR_BIT(i, j))
+                    {
+                        deg[i]++;
+                        deg[j]++;
+                        num_edges++;
+                    }
+                }
+            }
+            int max_deg = *std::max_element(deg, deg + 4);
 
-        fclose(fp);
+            for (int i = 0; i < 4; i++)
+            {
+                if (num_edges == 3)
+                    ntype[mask][i] = (max_deg == 3) ? (deg[i] == 3 ? CLAW_B : CLAW_A) : (deg[i] == 1 ? P4_A : P4_B);
+                else if (num_edges == 4)
+                    ntype[mask][i] = (max_deg == 2) ? C4_A : (deg[i] == 1 ? FLOW_A : deg[i] == 2 ? FLOW_B : FLOW_C);
+                else if (num_edges == 5)
+                    ntype[mask][i] = (deg[i] == 3) ? DIAM_B : DIAM_A;
+                else
+                    ntype[mask][i] = K4_A;
+            }
+        }
+        return ntype;
+    }
+
+    constexpr std::array<std::array<signed char, 3>, 1 << 3> ntype3 = make_ntype3();
+    constexpr std::array<std::array<signed char, 4>, 1 << 6> ntype4 = make_ntype4();
+
+    /*
+     * Number of set bits in the AND of the given rows of the adjacency matrix.
+     */
+    int64 rows_and_count(char *const *adjmat, const int *rows, int n, int row_bytes)
+    {
+        int64 total = 0;
+        int k = 0;
+        for (; k + 8 <= row_bytes; k += 8)
+        {
+            unsigned long long word = ~0ULL;
+            for (int r = 0; r < n; r++)
+            {
+                unsigned long long x;
+                memcpy(&x, adjmat[rows[r]] + k, 8);
+                word &= x;
+            }
+            total += __builtin_popcountll(word);
+        }
+        for (; k < row_bytes; k++)
+        {
+            unsigned char byte = 0xff;
+            for (int r = 0; r < n; r++)
+                byte &= adjmat[rows[r]][k];
+            total += __builtin_popcount(byte);
+        }
+
+        return total;
+    }
+
+    /* The 5 node counts of the orbit equations engine are kept in units of 1/EXT_SCALE, the
+     * least common multiple of the possible nremovable5 values.
+     */
+    const int64 EXT_SCALE = 12;
+
+    /*
+     * Settings for counting on a random sample of the 4 node subgraphs: each is kept with
+     * probability fraction, independently, drawn from a generator seeded by seed and the root
+     * node (so the sample does not depend on the thread count). The squares of each kept
+     * subgraph's contributions to the node type counts are summed into sqsum, for the variance
+     * of the estimates. sqsum is null for an exact count.
+     */
+    struct Sample
+    {
+        double fraction = 1;
+        unsigned long long seed = 0;
+        double *const *sqsum = nullptr;
+    };
+
+    /*
+     * The next number from a splitmix64 generator with the given state.
+     */
+    unsigned long long splitmix64(unsigned long long &state)
+    {
+        unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /*
+     * Count the orbits of every connected induced subgraph of 3 to 5 nodes whose smallest node
+     * is in a_begin..a_end-1, accumulating into the given node type counts.
+     *
+     * The subgraphs of 3 and 4 nodes are enumerated exactly once each with the ESU algorithm
+     * (Wernicke 2006). The 5 node subgraphs are not enumerated: for every 4 node subgraph Q, the
+     * number of outside nodes adjacent to each subset T of Q is a common neighbor count, and
+     * inclusion-exclusion over those counts gives the number of outside nodes v adjacent to
+     * exactly S, for every S. Each such v makes a 5 node graphlet with known node types. A 5 node
+     * graphlet is reached this way once for every node whose removal leaves it connected, so each
+     * node is credited EXT_SCALE / nremovable5 per discovery.
+     *
+     * Only graphlets of up to GS nodes are counted; the steps for larger ones are compiled out.
+     * With a sample, only the sampled 4 node subgraphs are counted (and extended to 5 nodes).
+     */
+    template <int GS, class Adjacency>
+    void count_equations(int a_begin, int a_end, int V, const int *const *edges_for, const Adjacency &adj, int64 *const *ncount,
+                         const Sample &sample)
+    {
+        const int row_bytes = V / 8 + 1;
+        const int row_words = row_bytes / 8 + 1;
+        std::vector<int> ext1;
+        std::vector<int> ext2;
+        std::vector<int> ext3;
+        const int *p;
+        int q[4];
+
+        for (q[0] = a_begin; q[0] < a_end; q[0]++)
+        {
+            int v = q[0];
+            unsigned long long state = sample.seed ^ ((unsigned long long)v << 32);
+
+            ext1.clear();
+            foreach_adj(p, v)
+            {
+                if (*p > v)
+                    ext1.push_back(*p);
+            }
+
+            for (unsigned i1 = 0; i1 < ext1.size(); i1++)
+            {
+                q[1] = ext1[i1];
+
+                /* extend with the neighbors of q[1] exclusive of {q[0]} */
+                ext2.assign(ext1.begin() + i1 + 1, ext1.end());
+                foreach_adj(p, q[1])
+                {
+                    if (*p > v && !Connected(q[0], *p))
+                        ext2.push_back(*p);
+                }
+
+                for (unsigned i2 = 0; i2 < ext2.size(); i2++)
+                {
+                    q[2] = ext2[i2];
+
+                    int mask3 = PAIR_BIT(0, 1);
+                    if (Connected(q[0], q[2]))
+                        mask3 |= PAIR_BIT(0, 2);
+                    if (Connected(q[1], q[2]))
+                        mask3 |= PAIR_BIT(1, 2);
+
+                    for (int i = 0; i < 3; i++)
+                        ncount[(int)ntype3[mask3][i]][q[i]]++;
+
+                    if constexpr (GS >= 4)
+                    {
+                        /* extend with the neighbors of q[2] exclusive of {q[0], q[1]} */
+                        ext3.assign(ext2.begin() + i2 + 1, ext2.end());
+                        foreach_adj(p, q[2])
+                        {
+                            if (*p > v && !Connected(q[0], *p) && !Connected(q[1], *p))
+                                ext3.push_back(*p);
+                        }
+
+                        for (unsigned i3 = 0; i3 < ext3.size(); i3++)
+                        {
+                            q[3] = ext3[i3];
+
+                            if (sample.sqsum && (splitmix64(state) >> 11) * 0x1.0p-53 >= sample.fraction)
+                                continue;
+
+                            int mask4 = mask3;
+                            for (int i = 0; i < 3; i++)
+                                if (Connected(q[i], q[3]))
+                                    mask4 |= PAIR_BIT(i, 3);
+
+                            for (int i = 0; i < 4; i++)
+                                ncount[(int)ntype4[mask4][i]][q[i]]++;
+                            if (sample.sqsum)
+                            {
+                                for (int i = 0; i < 4; i++)
+                                    sample.sqsum[(int)ntype4[mask4][i]][q[i]] += 1;
+                            }
+
+                            if constexpr (GS >= 5)
+                            {
+                                /* near[i]: the nodes of Q adjacent to q[i], and q[i] itself */
+                                int near[4];
+                                for (int i = 0; i < 4; i++)
+                                {
+                                    near[i] = 1 << i;
+                                    for (int j = 0; j < 4; j++)
+                                        if (j != i && (mask4 & (i < j ? PAIR_BIT(i, j) : PAIR_BIT(j, i))))
+                                            near[i] |= 1 << j;
+                                }
+
+                                /* common[T]: outside nodes adjacent to (at least) every node in T */
+                                int64 common[16];
+                                for (int t = 1; t < 16; t++)
+                                {
+                                    int low = -1;
+                                    int size = 0;
+                                    int inside = 15;
+                                    int rows[4];
+                                    for (int i = 0; i < 4; i++)
+                                    {
+                                        if (t & (1 << i))
+                                        {
+                                            if (low < 0 || DEGREE(q[i]) < DEGREE(q[low]))
+                                                low = i;
+                                            rows[size++] = q[i];
+                                            inside &= near[i];
+                                        }
+                                    }
+
+                                    if (size == 1)
+                                    {
+                                        common[t] = DEGREE(q[low]) - (__builtin_popcount(near[low]) - 1);
+                                    }
+                                    else if (Adjacency::ROWS && DEGREE(q[low]) * size > row_words)
+                                    {
+                                        /* AND the adjacency matrix rows; the rows also hold the self bit, so every
+                                         * node of Q adjacent or equal to all of T is counted and taken back off
+                                         */
+                                        if constexpr (Adjacency::ROWS)
+                                            common[t] = rows_and_count(adj.adjmat, rows, size, row_bytes) - __builtin_popcount(inside);
+                                    }
+                                    else
+                                    {
+                                        /* walk the neighbors of the lowest degree node of T */
+                                        int64 n = 0;
+                                        foreach_adj(p, q[low])
+                                        {
+                                            int u = *p;
+                                            if (u == q[0] || u == q[1] || u == q[2] || u == q[3])
+                                                continue;
+
+                                            bool all = true;
+                                            for (int i = 0; i < 4 && all; i++)
+                                                if (i != low && (t & (1 << i)) && !Connected(q[i], u))
+                                                    all = false;
+                                            n += all;
+                                        }
+                                        common[t] = n;
+                                    }
+                                }
+
+                                /* inclusion-exclusion: common[S] becomes the outside nodes adjacent to exactly S */
+                                for (int b = 0; b < 4; b++)
+                                    for (int t = 1; t < 16; t++)
+                                        if (!(t & (1 << b)))
+                                            common[t] -= common[t | (1 << b)];
+
+                                /* With a sample, the credits of Q to each node type of each of its nodes are
+                                 * collected first, so that their squares can be summed
+                                 */
+                                int credited[4][15];
+                                int64 credits[4][15];
+                                int num_credited[4] = {};
+
+                                for (int s = 1; s < 16; s++)
+                                {
+                                    if (common[s] == 0)
+                                        continue;
+
+                                    int mask5 = mask4 | (s << 6);
+                                    for (int i = 0; i < 4; i++)
+                                    {
+                                        int type = graphlets5[mask5].types[i];
+                                        int64 credit = common[s] * (EXT_SCALE / nremovable5[mask5][i]);
+                                        ncount[type][q[i]] += credit;
+
+                                        if (sample.sqsum)
+                                        {
+                                            int k = 0;
+                                            while (k < num_credited[i] && credited[i][k] != type)
+                                                k++;
+                                            if (k == num_credited[i])
+                                            {
+                                                credited[i][k] = type;
+                                                credits[i][k] = 0;
+                                                num_credited[i]++;
+                                            }
+                                            credits[i][k] += credit;
+                                        }
+                                    }
+                                }
+
+                                if (sample.sqsum)
+                                {
+                                    for (int i = 0; i < 4; i++)
+                                        for (int k = 0; k < num_credited[i]; k++)
+                                            sample.sqsum[credited[i][k]][q[i]] += (double)credits[i][k] * credits[i][k];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /*
+     * Count the orbits of every connected induced subgraph of 3 to GS nodes whose smallest node
+     * is in a_begin..a_end-1, accumulating into the given node type counts.
+     *
+     * Every subgraph is enumerated exactly once with the ESU algorithm (Wernicke 2006): from
+     * its smallest node v, a subgraph grows only by nodes greater than v that are adjacent to
+     * the newest node but to none of the earlier ones (the other candidates were offered
+     * before). Each subgraph is then classified by its edge mask, so unlike count_roots no
+     * graphlet is visited more than once and there is no overcount to divide out.
+     */
+    template <int GS, class Adjacency>
+    void count_esu(int a_begin, int a_end, const int *const *edges_for, const Adjacency &adj, int64 *const *ncount)
+    {
+        std::vector<int> ext1;
+        std::vector<int> ext2;
+        std::vector<int> ext3;
+        std::vector<int> ext4;
+        const int *p;
+        int q[5];
+
+        for (q[0] = a_begin; q[0] < a_end; q[0]++)
+        {
+            int v = q[0];
+
+            ext1.clear();
+            foreach_adj(p, v)
+            {
+                if (*p > v)
+                    ext1.push_back(*p);
+            }
+
+            for (unsigned i1 = 0; i1 < ext1.size(); i1++)
+            {
+                q[1] = ext1[i1];
+
+                /* extend with the neighbors of q[1] exclusive of {q[0]} */
+                ext2.assign(ext1.begin() + i1 + 1, ext1.end());
+                foreach_adj(p, q[1])
+                {
+                    if (*p > v && !Connected(q[0], *p))
+                        ext2.push_back(*p);
+                }
+
+                for (unsigned i2 = 0; i2 < ext2.size(); i2++)
+                {
+                    q[2] = ext2[i2];
+
+                    int mask3 = PAIR_BIT(0, 1) | (Connected(q[0], q[2]) << 1) | (Connected(q[1], q[2]) << 2);
+
+                    for (int i = 0; i < 3; i++)
+                        ncount[(int)ntype3[mask3][i]][q[i]]++;
+
+                    if constexpr (GS >= 4)
+                    {
+                        /* extend with the neighbors of q[2] exclusive of {q[0], q[1]} */
+                        ext3.assign(ext2.begin() + i2 + 1, ext2.end());
+                        foreach_adj(p, q[2])
+                        {
+                            if (*p > v && !Connected(q[0], *p) && !Connected(q[1], *p))
+                                ext3.push_back(*p);
+                        }
+
+                        for (unsigned i3 = 0; i3 < ext3.size(); i3++)
+                        {
+                            q[3] = ext3[i3];
+
+                            int mask4 = mask3 | (Connected(q[0], q[3]) << 3) | (Connected(q[1], q[3]) << 4) |
+                                        (Connected(q[2], q[3]) << 5);
+
+                            for (int i = 0; i < 4; i++)
+                                ncount[(int)ntype4[mask4][i]][q[i]]++;
+
+                            if constexpr (GS >= 5)
+                            {
+                                /* extend with the neighbors of q[3] exclusive of {q[0], q[1], q[2]} */
+                                ext4.assign(ext3.begin() + i3 + 1, ext3.end());
+                                foreach_adj(p, q[3])
+                                {
+                                    if (*p > v && !Connected(q[0], *p) && !Connected(q[1], *p) && !Connected(q[2], *p))
+                                        ext4.push_back(*p);
+                                }
+
+                                for (unsigned i4 = 0; i4 < ext4.size(); i4++)
+                                {
+                                    q[4] = ext4[i4];
+
+                                    int mask5 = mask4 | (Connected(q[0], q[4]) << 6) | (Connected(q[1], q[4]) << 7) |
+                                                (Connected(q[2], q[4]) << 8) | (Connected(q[3], q[4]) << 9);
+                                    Graphlet5 graphlet = graphlets5[mask5];
+
+                                    for (int i = 0; i < 5; i++)
+                                        ncount[graphlet.types[i]][q[i]]++;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * Build the CSR form of the graph with the given binary adjacency matrix.
+     * Only the upper triangle is read, and the diagonal (self-loops) is ignored.
+     *
+     * @param graph The adjacency matrix, as produced by Util::binarify.
+     *
+     * @return The graph in compressed sparse row form, with nodes numbered from 0.
+     */
+    CsrGraph to_csr(const std::vector<std::vector<unsigned>> &graph)
+    {
+        int V = graph.size();
+
+        CsrGraph csr;
+        csr.V = V;
+        csr.offsets.assign(V + 1, 0);
+
+        for (int i = 0; i < V; i++)
+        {
+            for (int j = i + 1; j < (int)graph[i].size() && j < V; j++)
+            {
+                if (graph[i][j] != 0)
+                {
+                    csr.offsets[i + 1]++;
+                    csr.offsets[j + 1]++;
+                }
+            }
+        }
+        for (int i = 0; i < V; i++)
+            csr.offsets[i + 1] += csr.offsets[i];
+
+        /* Rows are visited in order, so every neighbor list comes out sorted */
+        csr.adj.resize(csr.offsets[V]);
+        std::vector<int> fill(csr.offsets.begin(), csr.offsets.end() - 1);
+        for (int i = 0; i < V; i++)
+        {
+            for (int j = i + 1; j < (int)graph[i].size() && j < V; j++)
+            {
+                if (graph[i][j] != 0)
+                {
+                    csr.adj[fill[i]++] = j;
+                    csr.adj[fill[j]++] = i;
+                }
+            }
+        }
+
+        return csr;
+    }
+
+    /**
+     * Hash the edge set of the graph (64-bit FNV-1a over the node count and each edge i < j,
+     * in order), for use as a cache key. Graphs with the same nodes and edges hash the same
+     * however their input files were formatted or weighted.
+     *
+     * @param graph The graph, in compressed sparse row form.
+     *
+     * @return The hash of the graph.
+     */
+    unsigned long long fingerprint(const CsrGraph &graph)
+    {
+        unsigned long long hash = 0xCBF29CE484222325ULL;
+        auto mix = [&hash](unsigned x)
+        {
+            for (int b = 0; b < 4; b++)
+            {
+                hash ^= (x >> (8 * b)) & 0xFF;
+                hash *= 0x100000001B3ULL;
+            }
+        };
+
+        mix(graph.V);
+        for (int i = 0; i < graph.V; i++)
+        {
+            for (int k = graph.offsets[i]; k < graph.offsets[i + 1]; k++)
+            {
+                if (graph.adj[k] > i)
+                {
+                    mix(i);
+                    mix(graph.adj[k]);
+                }
+            }
+        }
+
+        return hash;
+    }
+
+    /* NODE ORDERING */
+
+    /*
+     * The nodes in order of decreasing degree (ties in input order).
+     */
+    std::vector<int> degree_order(const CsrGraph &graph)
+    {
+        std::vector<int> order(graph.V);
+        for (int i = 0; i < graph.V; i++)
+            order[i] = i;
+
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+                         { return graph.offsets[a + 1] - graph.offsets[a] > graph.offsets[b + 1] - graph.offsets[b]; });
+
+        return order;
+    }
+
+    /*
+     * The nodes in reverse Cuthill-McKee order: a breadth first search of each connected
+     * component, started from its lowest degree node and visiting neighbors in order of
+     * increasing degree, then reversed. Neighbors end up with nearby labels.
+     */
+    std::vector<int> rcm_order(const CsrGraph &graph)
+    {
+        auto degree = [&](int x)
+        { return graph.offsets[x + 1] - graph.offsets[x]; };
+
+        std::vector<int> by_degree(graph.V);
+        for (int i = 0; i < graph.V; i++)
+            by_degree[i] = i;
+        std::stable_sort(by_degree.begin(), by_degree.end(), [&](int a, int b)
+                         { return degree(a) < degree(b); });
+
+        std::vector<int> order;
+        std::vector<char> seen(graph.V, 0);
+        order.reserve(graph.V);
+
+        for (int start : by_degree)
+        {
+            if (seen[start])
+                continue;
+
+            seen[start] = 1;
+            order.push_back(start);
+            for (size_t head = order.size() - 1; head < order.size(); head++)
+            {
+                int x = order[head];
+                size_t first = order.size();
+                for (int k = graph.offsets[x]; k < graph.offsets[x + 1]; k++)
+                {
+                    int y = graph.adj[k];
+                    if (!seen[y])
+                    {
+                        seen[y] = 1;
+                        order.push_back(y);
+                    }
+                }
+                std::stable_sort(order.begin() + first, order.end(), [&](int a, int b)
+                                 { return degree(a) < degree(b); });
+            }
+        }
+
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+    /*
+     * The graph with node order[k] relabelled as node k.
+     */
+    CsrGraph relabel(const CsrGraph &graph, const std::vector<int> &order)
+    {
+        std::vector<int> label(graph.V);
+        for (int k = 0; k < graph.V; k++)
+            label[order[k]] = k;
+
+        CsrGraph relabelled;
+        relabelled.V = graph.V;
+        relabelled.offsets.assign(graph.V + 1, 0);
+        relabelled.adj.reserve(graph.adj.size());
+
+        for (int k = 0; k < graph.V; k++)
+        {
+            int x = order[k];
+            for (int e = graph.offsets[x]; e < graph.offsets[x + 1]; e++)
+                relabelled.adj.push_back(label[graph.adj[e]]);
+            std::sort(relabelled.adj.begin() + relabelled.offsets[k], relabelled.adj.end());
+            relabelled.offsets[k + 1] = relabelled.adj.size();
+        }
+
+        return relabelled;
+    }
+
+    /**
+     * The length of the GDVs counted for graphlets of up to the given number of nodes: the degree,
+     * then the orbits of the 3 node (3 orbits), 4 node (11 more) and 5 node (58 more) graphlets.
+     *
+     * @param graphlet_size The largest graphlet size counted, 3, 4 or 5.
+     *
+     * @return The number of entries in each GDV.
+     */
+    unsigned gdv_length(int graphlet_size)
+    {
+        return (graphlet_size <= 3) ? 1 + P4_A : (graphlet_size == 4) ? 1 + P5_A : 1 + 72;
+    }
+
+    /*
+     * Calculate the GDVs of every node in the given graph, exactly, or estimated from a random
+     * sample of the 4 node subgraphs if sample_fraction is below 1 (with the equations engine).
+     * When estimating, margins is set to the half-widths of 95% confidence intervals of the GDVs.
+     */
+    GdvMatrix count_gdvs(const CsrGraph &graph, unsigned threads, Engine engine, Order order, int graphlet_size,
+                         double sample_fraction, unsigned long long seed, GdvMatrix *margins)
+    {
+        int V = graph.V;
+        int i;
+        int j;
+
+        if (order != INPUT_ORDER)
+        {
+            /* Count on the relabelled graph, then put the GDVs back in input order */
+            std::vector<int> nodes = (order == DEGREE_ORDER) ? degree_order(graph) : rcm_order(graph);
+            auto relabelled_gdvs = count_gdvs(relabel(graph, nodes), threads, engine, INPUT_ORDER, graphlet_size,
+                                              sample_fraction, seed, margins);
+
+            GdvMatrix gdvs(V, relabelled_gdvs.cols);
+            for (int k = 0; k < V; k++)
+                std::copy(relabelled_gdvs[k], relabelled_gdvs[k] + gdvs.cols, gdvs[nodes[k]]);
+
+            if (margins)
+            {
+                GdvMatrix relabelled_margins(V, margins->cols);
+                for (int k = 0; k < V; k++)
+                    std::copy((*margins)[k], (*margins)[k] + margins->cols, relabelled_margins[nodes[k]]);
+                *margins = std::move(relabelled_margins);
+            }
+
+            return gdvs;
+        }
+
+        bool sampled = sample_fraction < 1;
+        if (sampled)
+            engine = EQUATIONS;
+
+        /* The edges[] array stores edges by node sequentially, so the last edge
+        of node n is followed by the first edge of n+1. edges_for[] stores
+        a pointer to the first edge of a node. The CSR adjacency array is
+        already laid out this way. */
+
+        const int **edges_for = new const int *[V + 1];
+        const int *edges = graph.adj.data();
+
+        for (i = 0; i <= V; i++)
+        {
+            edges_for[i] = edges + graph.offsets[i];
+        }
+
+        int64 gcount[29] = {};
+        int64 *ncount[72];
+        double *sqsum[72] = {};
+
+        /* allocate space for node type counts */
+        for (i = 0; i < 72; i++)
+        {
+            ncount[i] = (int64 *)calloc(V, sizeof(int64));
+            if (sampled)
+                sqsum[i] = (double *)calloc(V, sizeof(double));
+            if (!ncount[i] || (sampled && !sqsum[i]))
+            {
+                perror("calloc");
+                exit(1);
+            }
+        }
+
+        /* start counting */
+
+        threads = Parallel::resolve_threads(threads);
+        double worker_bytes = 72.0 * V * (sampled ? 16 : 8);
+        if (threads > 1 && (threads - 1) * worker_bytes > WORKER_COUNTS_MAX_BYTES)
+            threads = 1 + (unsigned)(WORKER_COUNTS_MAX_BYTES / worker_bytes);
+
+        /* Pick the adjacency test by the size and density of the graph */
+        unsigned words = V / 64 + 1;
+        double adjmat_bytes = (double)V * words * 8;
+        double avg_degree = V > 0 ? (double)graph.adj.size() / V : 0;
+        bool use_adjmat = adjmat_bytes <= ADJMAT_MAX_BYTES &&
+                          (engine == ENUMERATE || adjmat_bytes <= ADJMAT_SMALL_BYTES || avg_degree >= ADJMAT_MIN_DEGREE);
+        bool row_orbits = use_adjmat && engine == ENUMERATE && avg_degree >= ROW_ORBITS_MIN_FILL * words;
+
+        /* Per worker scratch space for the row intersection counts */
+        std::vector<std::vector<int>> wcommon(row_orbits ? threads : 0, std::vector<int>(V, 0));
+
+        auto run = [&](const auto &adj)
+        {
+            auto kernel = [&](unsigned w, int begin, int end, int64 *gc, int64 *const *nc, double *const *sq)
+            {
+                if (engine == EQUATIONS)
+                {
+                    Sample sample;
+                    if (sampled)
+                        sample = Sample{sample_fraction, seed, sq};
+
+                    if (graphlet_size <= 3)
+                        count_equations<3>(begin, end, V, edges_for, adj, nc, sample);
+                    else if (graphlet_size == 4)
+                        count_equations<4>(begin, end, V, edges_for, adj, nc, sample);
+                    else
+                        count_equations<5>(begin, end, V, edges_for, adj, nc, sample);
+                }
+                else if (engine == ESU)
+                {
+                    if (graphlet_size <= 3)
+                        count_esu<3>(begin, end, edges_for, adj, nc);
+                    else if (graphlet_size == 4)
+                        count_esu<4>(begin, end, edges_for, adj, nc);
+                    else
+                        count_esu<5>(begin, end, edges_for, adj, nc);
+                }
+                else if constexpr (std::decay_t<decltype(adj)>::ROWS)
+                {
+                    if (row_orbits)
+                    {
+                        if (graphlet_size <= 3)
+                        {
+                            count_row_orbits<3>(begin, end, V, edges_for, adj, nc, wcommon[w].data());
+                        }
+                        else if (graphlet_size == 4)
+                        {
+                            count_roots<4, true>(begin, end, edges_for, adj, gc, nc);
+                            count_row_orbits<4>(begin, end, V, edges_for, adj, nc, wcommon[w].data());
+                        }
+                        else
+                        {
+                            count_roots<5, true>(begin, end, edges_for, adj, gc, nc);
+                            count_row_orbits<5>(begin, end, V, edges_for, adj, nc, wcommon[w].data());
+                        }
+                    }
+                    else
+                    {
+                        if (graphlet_size <= 3)
+                            count_roots<3, false>(begin, end, edges_for, adj, gc, nc);
+                        else if (graphlet_size == 4)
+                            count_roots<4, false>(begin, end, edges_for, adj, gc, nc);
+                        else
+                            count_roots<5, false>(begin, end, edges_for, adj, gc, nc);
+                    }
+                }
+                else
+                {
+                    if (graphlet_size <= 3)
+                        count_roots<3, false>(begin, end, edges_for, adj, gc, nc);
+                    else if (graphlet_size == 4)
+                        count_roots<4, false>(begin, end, edges_for, adj, gc, nc);
+                    else
+                        count_roots<5, false>(begin, end, edges_for, adj, gc, nc);
+                }
+            };
+
+            if (threads == 1)
+            {
+                kernel(0, 0, V, gcount, ncount, sqsum);
+                return;
+            }
+
+            /* Every worker gets private graphlet and node type counts (worker 0 uses the
+             * final arrays), so the roots can be split among the workers in any way. The
+             * private counts are then added up in worker order; integer addition makes
+             * the result identical to the single threaded count.
+             */
+            std::vector<std::vector<int64>> wgcount(threads, std::vector<int64>(29, 0));
+            std::vector<std::vector<int64 *>> wncount(threads, std::vector<int64 *>(72));
+            std::vector<std::vector<double *>> wsqsum(threads, std::vector<double *>(72, nullptr));
+            for (unsigned w = 0; w < threads; w++)
+            {
+                for (int i = 0; i < 72; i++)
+                {
+                    wncount[w][i] = (w == 0) ? ncount[i] : (int64 *)calloc(V, sizeof(int64));
+                    if (sampled)
+                        wsqsum[w][i] = (w == 0) ? sqsum[i] : (double *)calloc(V, sizeof(double));
+                    if (!wncount[w][i] || (sampled && !wsqsum[w][i]))
+                    {
+                        perror("calloc");
+                        exit(1);
+                    }
+                }
+            }
+
+            Parallel::for_chunks(V, ROOT_CHUNK, threads, [&](unsigned w, unsigned begin, unsigned end)
+                                 { kernel(w, begin, end, wgcount[w].data(), wncount[w].data(), wsqsum[w].data()); });
+
+            for (unsigned w = 0; w < threads; w++)
+            {
+                for (int i = 0; i < 29; i++)
+                {
+                    gcount[i] += wgcount[w][i];
+                }
+                if (w == 0)
+                {
+                    continue;
+                }
+                for (int i = 0; i < 72; i++)
+                {
+                    for (int j = 0; j < V; j++)
+                    {
+                        ncount[i][j] += wncount[w][i][j];
+                    }
+                    free(wncount[w][i]);
+
+                    if (sampled)
+                    {
+                        for (int j = 0; j < V; j++)
+                        {
+                            sqsum[i][j] += wsqsum[w][i][j];
+                        }
+                        free(wsqsum[w][i]);
+                    }
+                }
+            }
+        };
+
+        if (use_adjmat)
+        {
+            /* allocate some space for the adjacency matrix, as whole 64-bit words per row */
+            unsigned long long *rows = (unsigned long long *)calloc((size_t)V * words, sizeof(unsigned long long));
+            char **adjmat = new char *[V]; // Oleksii
+            if (!rows)
+            {
+                perror("calloc");
+                exit(1);
+            }
+            for (i = 0; i < V; i++)
+            {
+                /* calloc zeroes the memory for us */
+                adjmat[i] = (char *)(rows + (size_t)i * words);
+
+                Connect(i, i); /* optimization hack */
+
+                const int *pb;
+                foreach_adj(pb, i)
+                {
+                    Connect(i, *pb);
+                }
+            }
+
+            run(BitAdjacency{adjmat, words});
+
+            free(rows);
+            delete[] adjmat;
+        }
+        else
+        {
+            std::vector<unsigned long long> slots;
+            run(hash_edges(graph, slots));
+        }
+
+        /* output */
+        GdvMatrix gdvs(V, gdv_length(graphlet_size));
+        if (margins)
+            *margins = GdvMatrix(V, gdvs.cols);
+
+        for (j = 0; j < V; j++)
+        {
+            unsigned long long *gdv = gdvs[j];
+
+            gdv[0] = DEGREE(j);
+
+            for (i = 0; i + 1 < (int)gdvs.cols; i++)
+            {
+                if (sampled && i >= P4_A)
+                {
+                    /* Horvitz-Thompson estimate of the count, and of its variance under
+                     * independent sampling of the 4 node subgraphs. The variance is taken as if
+                     * one more subgraph adding 1 had been sampled, so that counts with few or no
+                     * sampled subgraphs do not get near zero margins.
+                     */
+                    double scale = sample_fraction * (i >= P5_A ? EXT_SCALE : 1);
+                    double unit = (i >= P5_A) ? EXT_SCALE : 1;
+                    double variance = (sqsum[i][j] + unit * unit) * (1 - sample_fraction) / (scale * scale);
+                    gdv[1 + i] = (unsigned long long)std::llround(ncount[i][j] / scale);
+                    if (margins)
+                        (*margins)[j][1 + i] = (unsigned long long)std::ceil(1.96 * std::sqrt(variance));
+                }
+                else if (engine == EQUATIONS)
+                {
+                    gdv[1 + i] = ncount[i][j] / (i >= P5_A ? EXT_SCALE : 1);
+                }
+                else if (engine == ESU)
+                {
+                    gdv[1 + i] = ncount[i][j];
+                }
+                else if (row_orbits && (i == C3_A || i == C4_A || i == DIAM_A || i == DIAM_B || i == K4_A ||
+                                        (graphlet_size <= 3 && (i == P3_A || i == P3_B))))
+                {
+                    gdv[1 + i] = ncount[i][j];
+                }
+                else
+                {
+                    gdv[1 + i] = ncount[i][j] / overcount[ntype2gtype[i]];
+                }
+            }
+        }
+
+        for (i = 0; i < 72; i++)
+        {
+            free(ncount[i]);
+            free(sqsum[i]);
+        }
+        delete[] edges_for;
 
         return gdvs;
     }
 
+    /**
+     * Calculate the GDVs of every node in the given graph.
+     *
+     * @param graph The graph, in compressed sparse row form.
+     * @param threads The number of threads to count on (0 for one per hardware thread).
+     * @param engine The counting algorithm to use.
+     * @param order How to relabel the nodes before counting, for locality of the adjacency data.
+     * @param graphlet_size The largest graphlet size to count, 3, 4 or 5.
+     *
+     * @return The GDV of each node, in node order: its degree, then the orbit counts of the
+     *         graphlets of up to graphlet_size nodes (gdv_length entries in all).
+     */
+    GdvMatrix count(const CsrGraph &graph, unsigned threads, Engine engine, Order order, int graphlet_size)
+    {
+        return count_gdvs(graph, threads, engine, order, graphlet_size, 1, 0, nullptr);
+    }
+
+    /**
+     * Estimate the GDVs of every node in the given graph from a random sample of its subgraphs.
+     * The degrees and 3 node orbits are exact. Each connected 4 node subgraph is kept with
+     * probability fraction, and the 4 node orbits, and the 5 node orbits found from the kept
+     * subgraphs by the equations engine, are scaled up by 1 / fraction. The run time of the
+     * 4 and 5 node steps scales with fraction.
+     *
+     * @param graph The graph, in compressed sparse row form.
+     * @param threads The number of threads to count on (0 for one per hardware thread).
+     * @param order How to relabel the nodes before counting, for locality of the adjacency data.
+     * @param graphlet_size The largest graphlet size to count, 3, 4 or 5.
+     * @param fraction The sampling probability, in (0, 1]; 1 counts exactly.
+     * @param seed The random seed; the same seed gives the same estimates on any number of threads.
+     * @param margins Set to the half-width of the 95% confidence interval of each GDV entry
+     *        (0 for the exact entries).
+     *
+     * @return The estimated GDV of each node, in node order, as from count.
+     */
+    GdvMatrix estimate(const CsrGraph &graph, unsigned threads, Order order, int graphlet_size,
+                       double fraction, unsigned long long seed, GdvMatrix &margins)
+    {
+        return count_gdvs(graph, threads, EQUATIONS, order, graphlet_size, fraction, seed, &margins);
+    }
+
+    /* INCREMENTAL UPDATES */
+
+    /*
+     * Sorted neighbor lists that edges can be added to and removed from, and the state of the
+     * enumeration of the subgraphs around one changed edge.
+     */
+    struct EditableGraph
+    {
+        std::vector<std::vector<int>> nbrs;
+
+        /* While enumerating: bit i is set if the node is adjacent to sub[i], IN_SUB if it is in sub */
+        std::vector<unsigned char> near;
+        int sub[5];
+        std::vector<int> ext[5];
+        int max_size = 5;
+
+        static constexpr unsigned char IN_SUB = 0x80;
+
+        bool connected(int i, int j) const
+        {
+            return std::binary_search(nbrs[i].begin(), nbrs[i].end(), j);
+        }
+
+        void connect(int i, int j)
+        {
+            nbrs[i].insert(std::lower_bound(nbrs[i].begin(), nbrs[i].end(), j), j);
+            nbrs[j].insert(std::lower_bound(nbrs[j].begin(), nbrs[j].end(), i), i);
+        }
+
+        void disconnect(int i, int j)
+        {
+            nbrs[i].erase(std::lower_bound(nbrs[i].begin(), nbrs[i].end(), j));
+            nbrs[j].erase(std::lower_bound(nbrs[j].begin(), nbrs[j].end(), i));
+        }
+
+        /* Put w in sub at position k, or take it back out */
+        void place(int w, int k)
+        {
+            sub[k] = w;
+            near[w] |= IN_SUB;
+            for (int x : nbrs[w])
+                near[x] |= 1 << k;
+        }
+
+        void unplace(int w, int k)
+        {
+            near[w] &= ~IN_SUB;
+            for (int x : nbrs[w])
+                near[x] &= ~(1 << k);
+        }
+    };
+
+    /*
+     * Move the node types of the k node subgraph sub with the given edge mask from the mask
+     * without the edge sub[0]-sub[1] to the mask with it, or back if add is false.
+     */
+    void update_types(EditableGraph &graph, GdvMatrix &gdvs, int k, int mask, bool add)
+    {
+        int old_mask = add ? (mask & ~PAIR_BIT(0, 1)) : mask;
+        int new_mask = add ? mask : (mask & ~PAIR_BIT(0, 1));
+        const signed char *old_types = (k == 3) ? ntype3[old_mask].data() : (k == 4) ? ntype4[old_mask].data() : graphlets5[old_mask].types;
+        const signed char *new_types = (k == 3) ? ntype3[new_mask].data() : (k == 4) ? ntype4[new_mask].data() : graphlets5[new_mask].types;
+
+        /* Counts only go up and down by whole graphlets, so unsigned wraparound in between is harmless */
+        for (int i = 0; i < k; i++)
+        {
+            if (old_types[i] != new_types[i])
+            {
+                if (old_types[i] >= 0)
+                    gdvs[graph.sub[i]][1 + old_types[i]]--;
+                if (new_types[i] >= 0)
+                    gdvs[graph.sub[i]][1 + new_types[i]]++;
+            }
+        }
+    }
+
+    /*
+     * Update the node types of every connected subgraph of up to max_size nodes that extends
+     * sub[0..k-1] (edge mask mask) by nodes of ext[k]. Each subgraph is reached once: a node only
+     * joins the candidates when it is adjacent to the newest node of sub but to none of the
+     * earlier ones (ESU, Wernicke 2006, seeded with the changed edge instead of a root node).
+     */
+    void update_extensions(EditableGraph &graph, GdvMatrix &gdvs, int k, int mask, bool add)
+    {
+        std::vector<int> &ext = graph.ext[k];
+        while (!ext.empty())
+        {
+            int w = ext.back();
+            ext.pop_back();
+
+            int next_mask = mask | ((graph.near[w] & ((1 << k) - 1)) << (k * (k - 1) / 2));
+            graph.sub[k] = w;
+            update_types(graph, gdvs, k + 1, next_mask, add);
+
+            if (k + 1 >= graph.max_size || k + 1 == 5)
+                continue;
+
+            std::vector<int> &next_ext = graph.ext[k + 1];
+            next_ext = ext;
+            for (int x : graph.nbrs[w])
+            {
+                if (graph.near[x] == 0)
+                    next_ext.push_back(x);
+            }
+
+            graph.place(w, k);
+            update_extensions(graph, gdvs, k + 1, next_mask, add);
+            graph.unplace(w, k);
+        }
+    }
+
+    /*
+     * Add or remove the edge u-v, and update the GDVs of every node of a graphlet containing it.
+     */
+    void update_edge(EditableGraph &graph, GdvMatrix &gdvs, int u, int v, bool add)
+    {
+        if (u == v || u < 0 || v < 0 || u >= (int)graph.nbrs.size() || v >= (int)graph.nbrs.size())
+            throw std::invalid_argument("Edge " + std::to_string(u) + "-" + std::to_string(v) + " is not a valid edge.");
+        if (graph.connected(u, v) == add)
+            throw std::invalid_argument("Edge " + std::to_string(u) + "-" + std::to_string(v) +
+                                        (add ? " is already in the graph." : " is not in the graph."));
+
+        /* The subgraphs that change are those containing u and v that are connected with the edge */
+        if (add)
+            graph.connect(u, v);
+
+        graph.place(u, 0);
+        graph.place(v, 1);
+        graph.ext[2].clear();
+        for (int x : graph.nbrs[u])
+        {
+            if (!(graph.near[x] & EditableGraph::IN_SUB))
+                graph.ext[2].push_back(x);
+        }
+        for (int x : graph.nbrs[v])
+        {
+            if (graph.near[x] == (1 << 1))
+                graph.ext[2].push_back(x);
+        }
+
+        update_extensions(graph, gdvs, 2, PAIR_BIT(0, 1), add);
+        graph.unplace(u, 0);
+        graph.unplace(v, 1);
+
+        if (add)
+        {
+            gdvs[u][0]++;
+            gdvs[v][0]++;
+        }
+        else
+        {
+            graph.disconnect(u, v);
+            gdvs[u][0]--;
+            gdvs[v][0]--;
+        }
+    }
+
+    /**
+     * Update the GDVs of a graph for a batch of edge changes, without recounting. Only the
+     * graphlets containing a changed edge are visited, so a small batch costs far less than
+     * a full count, and gives the same GDVs.
+     *
+     * @param graph The graph the GDVs were calculated for.
+     * @param gdvs The GDVs of graph, as returned by count.
+     * @param added The edges to add, as pairs of node numbers; none may be in the graph.
+     * @param removed The edges to remove; all must be in the graph.
+     * @param graphlet_size The largest graphlet size the GDVs were counted for, 3, 4 or 5.
+     *
+     * @return The GDVs of the graph with the edges added and removed.
+     *
+     * @throws std::invalid_argument If an edge to add is already in the graph, or an edge to
+     *         remove is not, or a node number is out of range.
+     */
+    GdvMatrix update(const CsrGraph &graph, GdvMatrix gdvs, const std::vector<std::pair<int, int>> &added,
+                     const std::vector<std::pair<int, int>> &removed, int graphlet_size)
+    {
+        EditableGraph editable;
+        editable.max_size = std::min(std::max(graphlet_size, 3), 5);
+        editable.near.assign(graph.V, 0);
+        editable.nbrs.resize(graph.V);
+        for (int i = 0; i < graph.V; i++)
+            editable.nbrs[i].assign(graph.adj.begin() + graph.offsets[i], graph.adj.begin() + graph.offsets[i + 1]);
+
+        for (auto &e : removed)
+            update_edge(editable, gdvs, e.first, e.second, false);
+        for (auto &e : added)
+            update_edge(editable, gdvs, e.first, e.second, true);
+
+        return gdvs;
+    }
+
+    /**
+     * Find the edges that turn one graph into another on the same nodes.
+     *
+     * @param from The original graph.
+     * @param to The changed graph, with the same number of nodes.
+     * @param added Set to the edges of to that are not in from, as pairs i < j.
+     * @param removed Set to the edges of from that are not in to, as pairs i < j.
+     */
+    void edge_changes(const CsrGraph &from, const CsrGraph &to,
+                      std::vector<std::pair<int, int>> &added, std::vector<std::pair<int, int>> &removed)
+    {
+        added.clear();
+        removed.clear();
+        for (int i = 0; i < from.V; i++)
+        {
+            /* Merge the two sorted neighbor lists */
+            int a = from.offsets[i];
+            int b = to.offsets[i];
+            while (a < from.offsets[i + 1] || b < to.offsets[i + 1])
+            {
+                int x = (a < from.offsets[i + 1]) ? from.adj[a] : from.V;
+                int y = (b < to.offsets[i + 1]) ? to.adj[b] : to.V;
+                if (x == y)
+                {
+                    a++;
+                    b++;
+                    continue;
+                }
+                if (x < y)
+                {
+                    if (x > i)
+                        removed.emplace_back(i, x);
+                    a++;
+                }
+                else
+                {
+                    if (y > i)
+                        added.emplace_back(i, y);
+                    b++;
+                }
+            }
+        }
+    }
+
 }
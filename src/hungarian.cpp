@@ -2,17 +2,19 @@
 // Hungarian Algorithm O(n^3)
 // Reed Nelson
 
-/*
- * BUG:
- * The algorithm occasionally breaks on inputs where graph G > graph H.
- */
-
 #include <algorithm>
 #include <array>
+#include <cmath>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <type_traits>
 #include <vector>
 
+#include "util.h"
+#include "hungarian.h"
+
 namespace Hungarian
 {
     int prog = 0;                                               // PROGRESS
@@ -26,7 +28,8 @@ namespace Hungarian
     /*
      * If the matrix is not square, pad it so it is.
      */
-    void pad_matrix(std::vector<std::vector<double>> &matrix)
+    template <typename T>
+    void pad_matrix(std::vector<std::vector<T>> &matrix)
     {
         unsigned i_size = matrix.size();
         unsigned j_size = matrix[0].size();
@@ -35,14 +38,14 @@ namespace Hungarian
         {
             for (auto &vec : matrix)
             {
-                vec.resize(i_size, MAX);
+                vec.resize(i_size, Util::to_cost<T>(MAX));
             }
         }
         else if (i_size < j_size)
         {
             while (matrix.size() < j_size)
             {
-                matrix.push_back(std::vector<double>(j_size, MAX));
+                matrix.push_back(std::vector<T>(j_size, Util::to_cost<T>(MAX)));
             }
         }
     }
@@ -78,7 +81,8 @@ namespace Hungarian
     /*
      *
      */
-    void find_a_zero(int &row, int &col, const std::vector<std::vector<double>> &costs,
+    template <typename T>
+    void find_a_zero(int &row, int &col, const std::vector<std::vector<T>> &costs,
                      const std::vector<unsigned char> &row_cover, const std::vector<unsigned char> &col_cover)
     {
         unsigned r = 0;
@@ -195,7 +199,8 @@ namespace Hungarian
     /*
      * Find the smallest uncovered value in the cost matrix.
      */
-    void find_smallest(double &minval, const std::vector<std::vector<double>> &costs,
+    template <typename T>
+    void find_smallest(T &minval, const std::vector<std::vector<T>> &costs,
                        const std::vector<unsigned char> &row_cover, const std::vector<unsigned char> &col_cover)
     {
         for (unsigned r = 0; r < costs.size(); ++r)
@@ -218,7 +223,8 @@ namespace Hungarian
     /*
      * Reduce each row/col subtracting the minimum value in each row/col from all elements it.
      */
-    void step1(std::vector<std::vector<double>> &costs, int &step)
+    template <typename T>
+    void step1(std::vector<std::vector<T>> &costs, int &step)
     {
         // For each row of the matrix, find the smallest element and subtract it from every element in its row.
         for (auto &row : costs)
@@ -236,7 +242,7 @@ namespace Hungarian
         // For each col of the matrix, find the smallest element and subtract it from every element in its col.
         for (unsigned j = 0; j < costs.size(); ++j)
         {
-            double minval = MAX;
+            T minval = Util::to_cost<T>(MAX);
             for (unsigned i = 0; i < costs.size(); ++i)
             {
                 minval = std::min(minval, costs[i][j]);
@@ -266,7 +272,8 @@ namespace Hungarian
      * Before we go on to Step 3, we uncover all rows and columns so that we can use the
      * cover vectors to help us count the number of starred zeros.
      */
-    void step2(const std::vector<std::vector<double>> &costs, std::vector<std::vector<unsigned char>> &mask,
+    template <typename T>
+    void step2(const std::vector<std::vector<T>> &costs, std::vector<std::vector<unsigned char>> &mask,
                std::vector<unsigned char> &row_cover, std::vector<unsigned char> &col_cover, int &step)
     {
         for (unsigned r = 0; r < costs.size(); ++r)
@@ -332,7 +339,8 @@ namespace Hungarian
     /*
      * Find a noncovered zero and prime it. Save the smallest uncovered value and Go to Step 6.
      */
-    void step4(const std::vector<std::vector<double>> &costs, std::vector<std::vector<unsigned char>> &mask,
+    template <typename T>
+    void step4(const std::vector<std::vector<T>> &costs, std::vector<std::vector<unsigned char>> &mask,
                std::vector<unsigned char> &row_cover, std::vector<unsigned char> &col_cover,
                int &path_row_0, int &path_col_0, int &step)
     {
@@ -438,10 +446,11 @@ namespace Hungarian
      * values by an amount equal to the smallest value in the cost matrix, so we will not
      * jump over the optimal (i.e. minimal assignment) with this change.
      */
-    void step6(std::vector<std::vector<double>> &costs, const std::vector<unsigned char> &row_cover,
+    template <typename T>
+    void step6(std::vector<std::vector<T>> &costs, const std::vector<unsigned char> &row_cover,
                const std::vector<unsigned char> &col_cover, int &step)
     {
-        double minval = MAX;
+        T minval = Util::to_cost<T>(MAX);
         find_smallest(minval, costs, row_cover, col_cover);
 
         for (unsigned r = 0; r < costs.size(); ++r)
@@ -465,19 +474,19 @@ namespace Hungarian
     /*
      * Calculates the optimal cost from mask matrix.
      */
-    std::vector<std::vector<double>> output_solution(const std::vector<std::vector<double>> &original,
+    std::vector<std::vector<double>> output_solution(Util::CostProvider &original,
                                                      const std::vector<std::vector<unsigned char>> &mask)
     {
         std::vector<std::vector<double>> alignment;
 
-        for (unsigned r = 0; r < original.size(); ++r)
+        for (unsigned r = 0; r < original.rows; ++r)
         {
             std::vector<double> row;
-            for (unsigned c = 0; c < original[r].size(); ++c)
+            for (unsigned c = 0; c < original.cols; ++c)
             {
                 if (mask[r][c] != 0)
                 {
-                    row.push_back(1 - original[r][c]);
+                    row.push_back(1 - original.cost(r, c));
                 }
                 else
                 {
@@ -490,32 +499,28 @@ namespace Hungarian
     }
 
     /*
-     * Driver code.
+     * Driver code, with the working costs held as T (see Util::to_cost).
      */
-    std::vector<std::vector<double>> hungarian(std::vector<std::vector<double>> original)
+    template <typename T>
+    std::vector<std::vector<double>> solve(Util::CostProvider &original)
     {
-        // Validate input values
-        for (auto vec : original)
+        // Copy the costs into the working matrix, validating them as they come
+        std::vector<std::vector<T>> costs(original.rows);
+        for (unsigned r = 0; r < original.rows; ++r)
         {
-            for (auto val : vec)
+            const double *row = original.row(r);
+            costs[r].resize(original.cols);
+            for (unsigned c = 0; c < original.cols; ++c)
             {
-                if (val < 0 || val > MAX)
+                if (row[c] < 0 || row[c] > MAX)
                 {
                     std::cout << "Error: Input contains invalid values. All entries must be in range [0,1]." << std::endl;
                     return {};
                 }
+                costs[r][c] = Util::to_cost<T>(row[c]);
             }
         }
 
-        // Duplicate original matrix
-        std::vector<std::vector<double>> costs(original.size(), std::vector<double>(original.begin()->size()));
-        auto it = original.begin();
-        for (auto &vec : costs)
-        {
-            std::copy(it->begin(), it->end(), vec.begin());
-            it = std::next(it);
-        }
-
         // Make the matrix square
         pad_matrix(costs);
 
@@ -531,8 +536,9 @@ namespace Hungarian
         int path_row_0; // temporary to hold the smallest uncovered value
         int path_col_0;
 
-        // Array for the augmenting path algorithm
-        std::vector<std::vector<int>> path(costs.size() + 1, std::vector<int>(2, 0));
+        // Array for the augmenting path algorithm; a path alternates between primed and starred
+        // zeros, and has at most one of each per row plus the primed zero it ends in
+        std::vector<std::vector<int>> path(2 * costs.size() + 1, std::vector<int>(2, 0));
 
         bool done = false;
         int step = 1;
@@ -562,9 +568,9 @@ namespace Hungarian
             case 7:
                 for (auto &vec : mask)
                 {
-                    vec.resize(original.begin()->size());
+                    vec.resize(original.cols);
                 }
-                mask.resize(original.size());
+                mask.resize(original.rows);
                 done = true;
                 break;
             default:
@@ -576,4 +582,664 @@ namespace Hungarian
         return output_solution(original, mask);
     }
 
+    /*
+     * The alignment given by the node of H assigned to each node of G, or -1 for none.
+     */
+    std::vector<std::vector<double>> output_solution(Util::CostProvider &original, const std::vector<int> &row_sol)
+    {
+        std::vector<std::vector<double>> alignment(original.rows, std::vector<double>(original.cols, 0));
+        for (unsigned r = 0; r < original.rows; ++r)
+        {
+            if (row_sol[r] >= 0)
+            {
+                alignment[r][row_sol[r]] = 1 - original.cost(r, row_sol[r]);
+            }
+        }
+        return alignment;
+    }
+
+    /*
+     * Two rounds of augmenting row reduction on a square n x n matrix: a free row takes its
+     * cheapest column, lowering that column's dual by the gap to its second cheapest, and the
+     * row it displaces goes again. The rows retried at once are limited to n per round, which
+     * rounding in v could otherwise defeat. The rows still free are left in free.
+     */
+    template <typename T, typename D>
+    void augmenting_row_reduction(const std::vector<T> &costs, unsigned n, std::vector<unsigned> &free,
+                                  std::vector<int> &row_sol, std::vector<int> &col_sol, std::vector<D> &v)
+    {
+        const D BIG = std::numeric_limits<D>::max();
+        auto cost = [&](unsigned i, unsigned j)
+        {
+            return (D)costs[(size_t)i * n + j];
+        };
+
+        for (unsigned round = 0; round < 2; ++round)
+        {
+            std::vector<unsigned> rows;
+            rows.swap(free);
+            unsigned retries = 0;
+            unsigned k = 0;
+            while (k < rows.size())
+            {
+                unsigned i = rows[k++];
+
+                // The cheapest and second cheapest reduced costs in the row
+                D u_min = cost(i, 0) - v[0];
+                D u_sub_min = BIG;
+                unsigned j1 = 0;
+                unsigned j2 = 0;
+                for (unsigned j = 1; j < n; ++j)
+                {
+                    D h = cost(i, j) - v[j];
+                    if (h < u_sub_min)
+                    {
+                        if (h >= u_min)
+                        {
+                            u_sub_min = h;
+                            j2 = j;
+                        }
+                        else
+                        {
+                            u_sub_min = u_min;
+                            u_min = h;
+                            j2 = j1;
+                            j1 = j;
+                        }
+                    }
+                }
+
+                int i0 = col_sol[j1];
+                bool lowered = u_min < u_sub_min;
+                if (lowered)
+                {
+                    v[j1] -= u_sub_min - u_min;
+                }
+                else if (i0 >= 0)
+                {
+                    // A tie: take the second column instead, unless it is assigned too
+                    j1 = j2;
+                    i0 = col_sol[j2];
+                }
+                row_sol[i] = j1;
+                col_sol[j1] = i;
+
+                if (i0 >= 0)
+                {
+                    row_sol[i0] = -1;
+                    if (lowered && retries++ < n)
+                    {
+                        rows[--k] = i0;
+                    }
+                    else
+                    {
+                        free.push_back(i0);
+                    }
+                }
+            }
+        }
+    }
+
+    /*
+     * The first phases of the Jonker-Volgenant algorithm (Jonker and Volgenant 1987) on a square
+     * n x n matrix: column reduction, reduction transfer and two rounds of augmenting row
+     * reduction, which assign most rows cheaply. Returns the rows left free.
+     */
+    template <typename T, typename D>
+    std::vector<unsigned> reduce(const std::vector<T> &costs, unsigned n, std::vector<int> &row_sol,
+                                 std::vector<int> &col_sol, std::vector<D> &v)
+    {
+        const D BIG = std::numeric_limits<D>::max();
+        auto cost = [&](unsigned i, unsigned j)
+        {
+            return (D)costs[(size_t)i * n + j];
+        };
+
+        if (n == 1)
+        {
+            row_sol[0] = 0;
+            col_sol[0] = 0;
+            return {};
+        }
+
+        // Column reduction: assign each column to the row of its cheapest entry, if that row is free
+        std::vector<unsigned> matches(n, 0);
+        for (unsigned j = n; j-- > 0;)
+        {
+            unsigned i_min = 0;
+            D min = cost(0, j);
+            for (unsigned i = 1; i < n; ++i)
+            {
+                if (cost(i, j) < min)
+                {
+                    min = cost(i, j);
+                    i_min = i;
+                }
+            }
+            v[j] = min;
+            if (++matches[i_min] == 1)
+            {
+                row_sol[i_min] = j;
+                col_sol[j] = i_min;
+            }
+        }
+
+        // Reduction transfer: rows with one match give their slack to their column
+        std::vector<unsigned> free;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            if (matches[i] == 0)
+            {
+                free.push_back(i);
+            }
+            else if (matches[i] == 1)
+            {
+                unsigned j1 = row_sol[i];
+                D min = BIG;
+                for (unsigned j = 0; j < n; ++j)
+                {
+                    if (j != j1 && cost(i, j) - v[j] < min)
+                    {
+                        min = cost(i, j) - v[j];
+                    }
+                }
+                v[j1] -= min;
+            }
+        }
+
+        // Augmenting row reduction
+        augmenting_row_reduction(costs, n, free, row_sol, col_sol, v);
+        return free;
+    }
+
+    /*
+     * Start from the state an earlier solve ended in, for costs that have changed a little:
+     * take its duals and assignment, then free the rows whose column is no longer their
+     * cheapest at those duals, so that only they are solved again. On an n x m matrix with
+     * n < m, the unassigned columns must share the largest dual; the columns freed are raised
+     * to it, which can free more rows in turn. Returns the rows left free.
+     */
+    template <typename T, typename D>
+    std::vector<unsigned> repair(const std::vector<T> &costs, unsigned n, unsigned m, const Util::WarmStart &warm,
+                                 std::vector<int> &row_sol, std::vector<int> &col_sol, std::vector<D> &v)
+    {
+        auto cost = [&](unsigned i, unsigned j)
+        {
+            return (D)costs[(size_t)i * m + j];
+        };
+
+        for (unsigned j = 0; j < m; ++j)
+        {
+            if constexpr (std::is_integral_v<D>)
+            {
+                v[j] = std::llround(warm.duals[j] * Util::FIXED_ONE);
+            }
+            else
+            {
+                v[j] = (D)warm.duals[j];
+            }
+        }
+        for (unsigned i = 0; i < n; ++i)
+        {
+            int j = warm.assignment[i];
+            if (j >= 0 && (unsigned)j < m && col_sol[j] < 0)
+            {
+                row_sol[i] = j;
+                col_sol[j] = i;
+            }
+        }
+
+        // Raise the unassigned columns to the largest dual
+        D top = *std::max_element(v.begin(), v.end());
+        std::vector<unsigned> raised;
+        if (n < m)
+        {
+            for (unsigned j = 0; j < m; ++j)
+            {
+                if (col_sol[j] < 0)
+                {
+                    v[j] = top;
+                }
+            }
+        }
+
+        // Free the rows with a cheaper column than their own
+        std::vector<unsigned> free;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            if (row_sol[i] < 0)
+            {
+                free.push_back(i);
+                continue;
+            }
+
+            unsigned own = row_sol[i];
+            D h = cost(i, own) - v[own];
+            for (unsigned j = 0; j < m; ++j)
+            {
+                if (cost(i, j) - v[j] < h)
+                {
+                    row_sol[i] = -1;
+                    col_sol[own] = -1;
+                    free.push_back(i);
+                    if (n < m)
+                    {
+                        v[own] = top;
+                        raised.push_back(own);
+                    }
+                    break;
+                }
+            }
+        }
+
+        // The raised columns can be cheaper for the rows still assigned
+        while (!raised.empty())
+        {
+            std::vector<unsigned> columns;
+            columns.swap(raised);
+            for (unsigned i = 0; i < n; ++i)
+            {
+                if (row_sol[i] < 0)
+                {
+                    continue;
+                }
+
+                unsigned own = row_sol[i];
+                D h = cost(i, own) - v[own];
+                for (unsigned j : columns)
+                {
+                    if (cost(i, j) - v[j] < h)
+                    {
+                        row_sol[i] = -1;
+                        col_sol[own] = -1;
+                        free.push_back(i);
+                        v[own] = top;
+                        raised.push_back(own);
+                        break;
+                    }
+                }
+            }
+        }
+
+        return free;
+    }
+
+    /*
+     * The Jonker-Volgenant algorithm: each free row is assigned along a shortest augmenting path
+     * (Dijkstra's algorithm on the reduced costs), updating the column duals v. A square matrix
+     * is first reduced as above; a rectangular one is solved as it is, with n <= m rows (the
+     * transpose if G is the larger graph) and every row free, as the reductions would leave
+     * the duals of the unassigned columns out of step. Working storage is the n x m costs in
+     * one contiguous buffer, and O(m) vectors. The costs are held as T; the duals are signed
+     * (D), as they can go below 0. Given the state of an earlier solve of a matrix the same
+     * size, only the rows it no longer fits are solved again, a square matrix reducing them
+     * first; the state the solve ends in is left in warm.
+     */
+    template <typename T>
+    std::vector<std::vector<double>> jonker_volgenant(Util::CostProvider &original, Util::WarmStart &warm)
+    {
+        typedef std::conditional_t<std::is_integral_v<T>, long long, T> D;
+
+        // Copy the costs into the working matrix, validating them as they come
+        bool transpose = original.rows > original.cols;
+        unsigned n = std::min(original.rows, original.cols);
+        unsigned m = std::max(original.rows, original.cols);
+        std::vector<T> costs((size_t)n * m);
+        for (unsigned r = 0; r < original.rows; ++r)
+        {
+            const double *row = original.row(r);
+            for (unsigned c = 0; c < original.cols; ++c)
+            {
+                if (row[c] < 0 || row[c] > MAX)
+                {
+                    std::cout << "Error: Input contains invalid values. All entries must be in range [0,1]." << std::endl;
+                    return {};
+                }
+                costs[transpose ? (size_t)c * m + r : (size_t)r * m + c] = Util::to_cost<T>(row[c]);
+            }
+        }
+        auto cost = [&](unsigned i, unsigned j)
+        {
+            return (D)costs[(size_t)i * m + j];
+        };
+
+        std::vector<int> row_sol(n, -1); // column assigned to each row
+        std::vector<int> col_sol(m, -1); // row assigned to each column
+        std::vector<D> v(m, 0);          // column duals
+        std::vector<unsigned> free;
+        if (n > 0 && warm.rows == original.rows && warm.cols == original.cols && warm.assignment.size() == n && warm.duals.size() == m)
+        {
+            free = repair(costs, n, m, warm, row_sol, col_sol, v);
+            if (n == m && n > 1)
+            {
+                augmenting_row_reduction(costs, n, free, row_sol, col_sol, v);
+            }
+        }
+        else if (n == m)
+        {
+            free = reduce(costs, n, row_sol, col_sol, v);
+        }
+        else
+        {
+            for (unsigned i = 0; i < n; ++i)
+            {
+                free.push_back(i);
+            }
+        }
+
+        // Augment along a shortest path from each free row to a free column
+        std::vector<D> d(m);           // shortest path lengths
+        std::vector<unsigned> pred(m); // row preceding each column in the paths
+        std::vector<unsigned> cols(m); // columns: scanned, then ready, then still to do
+        for (unsigned free_row : free)
+        {
+            for (unsigned j = 0; j < m; ++j)
+            {
+                d[j] = cost(free_row, j) - v[j];
+                pred[j] = free_row;
+                cols[j] = j;
+            }
+
+            unsigned low = 0; // cols[0 .. low - 1] are scanned
+            unsigned up = 0;  // cols[low .. up - 1] are at the minimum distance, ready to scan
+            unsigned last = 0;
+            unsigned end_of_path = 0;
+            bool found = false;
+            D min = 0;
+            while (!found)
+            {
+                if (up == low)
+                {
+                    // Collect the columns at the next smallest distance
+                    last = low;
+                    min = d[cols[up++]];
+                    for (unsigned k = up; k < m; ++k)
+                    {
+                        unsigned j = cols[k];
+                        D h = d[j];
+                        if (h <= min)
+                        {
+                            if (h < min)
+                            {
+                                up = low;
+                                min = h;
+                            }
+                            cols[k] = cols[up];
+                            cols[up++] = j;
+                        }
+                    }
+
+                    // A free column among them ends the path
+                    for (unsigned k = low; k < up; ++k)
+                    {
+                        if (col_sol[cols[k]] < 0)
+                        {
+                            end_of_path = cols[k];
+                            found = true;
+                            break;
+                        }
+                    }
+                }
+
+                if (!found)
+                {
+                    // Scan a column at the minimum distance, through the row assigned to it
+                    unsigned j1 = cols[low++];
+                    unsigned i = col_sol[j1];
+                    D h = cost(i, j1) - v[j1] - min;
+                    for (unsigned k = up; k < m; ++k)
+                    {
+                        unsigned j = cols[k];
+                        D dist = cost(i, j) - v[j] - h;
+                        if (dist < d[j])
+                        {
+                            d[j] = dist;
+                            pred[j] = i;
+                            if (dist == min)
+                            {
+                                if (col_sol[j] < 0)
+                                {
+                                    end_of_path = j;
+                                    found = true;
+                                    break;
+                                }
+                                cols[k] = cols[up];
+                                cols[up++] = j;
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Update the duals of the scanned columns
+            for (unsigned k = 0; k < last; ++k)
+            {
+                unsigned j = cols[k];
+                v[j] += d[j] - min;
+            }
+
+            // Flip the assignments along the path
+            unsigned i;
+            do
+            {
+                i = pred[end_of_path];
+                col_sol[end_of_path] = i;
+                int next = row_sol[i];
+                row_sol[i] = end_of_path;
+                end_of_path = next;
+            } while (i != free_row);
+        }
+
+        // Keep the state for the next solve
+        warm.rows = original.rows;
+        warm.cols = original.cols;
+        warm.assignment = row_sol;
+        warm.duals.resize(m);
+        for (unsigned j = 0; j < m; ++j)
+        {
+            warm.duals[j] = Util::from_cost(v[j]);
+        }
+
+        // The column of H assigned to each node of G
+        if (transpose)
+        {
+            row_sol.swap(col_sol);
+        }
+        return output_solution(original, row_sol);
+    }
+
+    /*
+     * The Jonker-Volgenant shortest augmenting paths over candidate lists: node i of G may only
+     * be aligned to its candidates in H. Each row also has a dummy column of its own, m + i,
+     * costing more than any set of real pairs, so that every row can be assigned; the rows
+     * end up on their dummies only where the candidates leave no other way, which is then
+     * reported, and those nodes of G are left unaligned. The paths are found with Dijkstra's
+     * algorithm and a binary heap, so the work and memory grow with the number of candidates
+     * rather than with |G| * |H|. The costs are worked on as doubles.
+     */
+    std::vector<std::vector<double>> hungarian(const Util::SparseCostMatrix &candidates)
+    {
+        const double INF = std::numeric_limits<double>::infinity();
+        unsigned n = candidates.rows;
+        unsigned m = candidates.cols;
+        double dummy_cost = (double)n * MAX + 1;
+
+        for (double cost : candidates.values)
+        {
+            if (cost < 0 || cost > MAX)
+            {
+                std::cout << "Error: Input contains invalid values. All entries must be in range [0,1]." << std::endl;
+                return {};
+            }
+        }
+
+        // Call fn(j, cost) for each column row i may be assigned to
+        auto for_each_column = [&](unsigned i, auto fn)
+        {
+            for (size_t e = candidates.offsets[i]; e < candidates.offsets[i + 1]; ++e)
+            {
+                fn(candidates.indices[e], candidates.values[e]);
+            }
+            fn(m + i, dummy_cost);
+        };
+        auto cost = [&](unsigned i, unsigned j)
+        {
+            if (j >= m)
+            {
+                return dummy_cost;
+            }
+            auto first = candidates.indices.begin() + candidates.offsets[i];
+            auto last = candidates.indices.begin() + candidates.offsets[i + 1];
+            return candidates.values[std::lower_bound(first, last, j) - candidates.indices.begin()];
+        };
+
+        std::vector<int> row_sol(n, -1);    // column assigned to each row
+        std::vector<int> col_sol(m + n, -1); // row assigned to each column
+        std::vector<double> v(m + n, 0);     // column duals
+        std::vector<double> d(m + n, INF);   // shortest path lengths
+        std::vector<unsigned> pred(m + n);   // row preceding each column in the paths
+        std::vector<unsigned char> scanned(m + n, 0);
+        std::vector<unsigned> touched;
+        std::vector<unsigned> scanned_cols;
+        std::vector<std::pair<double, unsigned>> heap; // columns by distance, a min-heap
+
+        for (unsigned free_row = 0; free_row < n; ++free_row)
+        {
+            for_each_column(free_row, [&](unsigned j, double c)
+                            {
+                                d[j] = c - v[j];
+                                pred[j] = free_row;
+                                touched.push_back(j);
+                                heap.push_back({d[j], j});
+                                std::push_heap(heap.begin(), heap.end(), std::greater<>()); });
+
+            // Scan the columns in order of distance until a free one is reached
+            unsigned end_of_path = 0;
+            double min = 0;
+            while (!heap.empty())
+            {
+                std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+                auto [dist, j1] = heap.back();
+                heap.pop_back();
+                if (scanned[j1] || dist > d[j1])
+                {
+                    continue;
+                }
+                scanned[j1] = 1;
+                scanned_cols.push_back(j1);
+                min = dist;
+                if (col_sol[j1] < 0)
+                {
+                    end_of_path = j1;
+                    break;
+                }
+
+                // Relax the columns of the row assigned to it
+                unsigned i = col_sol[j1];
+                double h = cost(i, j1) - v[j1] - min;
+                for_each_column(i, [&](unsigned j, double c)
+                                {
+                                    double dist_j = c - v[j] - h;
+                                    if (!scanned[j] && dist_j < d[j])
+                                    {
+                                        if (d[j] == INF)
+                                        {
+                                            touched.push_back(j);
+                                        }
+                                        d[j] = dist_j;
+                                        pred[j] = i;
+                                        heap.push_back({dist_j, j});
+                                        std::push_heap(heap.begin(), heap.end(), std::greater<>());
+                                    } });
+            }
+
+            // Update the duals of the scanned columns, and reset the search
+            for (unsigned j : scanned_cols)
+            {
+                v[j] += d[j] - min;
+            }
+            for (unsigned j : touched)
+            {
+                d[j] = INF;
+                scanned[j] = 0;
+            }
+            touched.clear();
+            scanned_cols.clear();
+            heap.clear();
+
+            // Flip the assignments along the path
+            unsigned i;
+            do
+            {
+                i = pred[end_of_path];
+                col_sol[end_of_path] = i;
+                int next = row_sol[i];
+                row_sol[i] = end_of_path;
+                end_of_path = next;
+            } while (i != free_row);
+        }
+
+        // Leave the rows on dummy columns unaligned
+        unsigned unaligned = 0;
+        std::vector<std::vector<double>> alignment(n, std::vector<double>(m, 0));
+        for (unsigned i = 0; i < n; ++i)
+        {
+            if ((unsigned)row_sol[i] < m)
+            {
+                alignment[i][row_sol[i]] = 1 - cost(i, row_sol[i]);
+            }
+            else
+            {
+                ++unaligned;
+            }
+        }
+        if (unaligned > n - std::min(n, m))
+        {
+            std::cout << "Warning: The candidates admit no complete alignment; " << unaligned
+                      << " nodes of G are assigned to dummy nodes and left unaligned." << std::endl;
+        }
+
+        return alignment;
+    }
+
+    /*
+     * Find the optimal alignment with the given solver, with the working costs in the given
+     * precision. Munkres works on 16-bit fixed point costs in 32 bits, as the reductions can
+     * raise covered entries past 1; Jonker-Volgenant leaves the costs as they are. The auction
+     * always works on 16-bit fixed point costs, on the given number of threads. Only
+     * Jonker-Volgenant starts from and updates the warm start state.
+     */
+    std::vector<std::vector<double>> hungarian(Util::CostProvider &original, Util::Precision precision, Solver solver, unsigned threads,
+                                               Util::WarmStart &warm)
+    {
+        if (solver == AUCTION || solver == EXACT_AUCTION)
+        {
+            return auction(original, solver == EXACT_AUCTION, threads);
+        }
+
+        // Every pair of a dense matrix is a candidate
+        if (solver == JONKER_VOLGENANT || solver == SPARSE_JONKER_VOLGENANT)
+        {
+            switch (precision)
+            {
+            case Util::FLOAT_COSTS:
+                return jonker_volgenant<float>(original, warm);
+            case Util::FIXED16_COSTS:
+                return jonker_volgenant<Util::Fixed16>(original, warm);
+            default:
+                return jonker_volgenant<double>(original, warm);
+            }
+        }
+
+        switch (precision)
+        {
+        case Util::FLOAT_COSTS:
+            return solve<float>(original);
+        case Util::FIXED16_COSTS:
+            return solve<unsigned>(original);
+        default:
+            return solve<double>(original);
+        }
+    }
+
 } // end of namespace Hungarian
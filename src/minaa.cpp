@@ -4,15 +4,18 @@
 
 #include <chrono>
 #include <cstdio>
+#include <functional>
 #include <vector>
 #include <iostream>
 #include <stdexcept>
+#include <type_traits>
 
+#include "parallel.h"
+#include "util.h"
 #include "hungarian.h"
-#include "gdvs_dist.h"
 #include "graphcrunch.h"
+#include "gdvs_dist.h"
 #include "file_io.h"
-#include "util.h"
 
 /*
  * Main function
@@ -49,7 +52,37 @@ int main(int argc, char *argv[])
         auto do_timestamp = (args[11] == "1");             // include a timestamp in the directory name?
         auto do_greekstamp = (args[12] == "1");            // include a greekstamp in the directory name?
         auto do_similarity_conversion = (args[13] == "1"); // convert biological similarity to costs?
+        auto threads = (unsigned)std::stoul(args[14]);     // number of worker threads
+        auto engine = (args[15] == "orca")  ? GraphCrunch::EQUATIONS
+                      : (args[15] == "esu") ? GraphCrunch::ESU
+                                            : GraphCrunch::ENUMERATE; // GDV counting engine
+        auto order = (args[16] == "degree") ? GraphCrunch::DEGREE_ORDER
+                     : (args[16] == "rcm")  ? GraphCrunch::RCM_ORDER
+                                            : GraphCrunch::INPUT_ORDER; // node order for GDV counting
+        auto cache_dir = args[17];                         // GDV cache directory
+        auto graphlet_size = std::stoi(args[18]);          // largest graphlet size counted
+        auto sample_fraction = std::stod(args[19]);        // fraction of 4 node subgraphs sampled for GDV estimates
+        auto knn = (unsigned)std::stoul(args[20]);         // candidate H nodes kept per G node
+        auto precision = (args[21] == "float")     ? Util::FLOAT_COSTS
+                         : (args[21] == "fixed16") ? Util::FIXED16_COSTS
+                                                   : Util::DOUBLE_COSTS; // precision of the solver's working costs
+        GDVs_Dist::Measure measure;                        // how the GDVs of two nodes are compared
+        measure.metric = (args[22] == "cosine")      ? GDVs_Dist::COSINE
+                         : (args[22] == "agreement") ? GDVs_Dist::AGREEMENT
+                         : (args[22] == "l1")        ? GDVs_Dist::WEIGHTED_L1
+                                                     : GDVs_Dist::GRAAL;
+        if (args[23] != "") measure.orbits = Util::parse_orbits(args[23]);
+        auto solver = (args[24] == "jv")              ? Hungarian::JONKER_VOLGENANT
+                      : (args[24] == "sparse")        ? Hungarian::SPARSE_JONKER_VOLGENANT
+                      : (args[24] == "auction")       ? Hungarian::AUCTION
+                      : (args[24] == "auction-exact") ? Hungarian::EXACT_AUCTION
+                                                      : Hungarian::MUNKRES; // assignment solver
+        auto warm_file = args[25];                         // file the solver's state is kept in between runs
+        auto update_fraction = std::stod(args[26]);        // most edge changes, as a fraction of H's edges, for a GDV update
         auto do_bio = (bio_file != "");                    // biological data file provided?
+        auto do_sample = (sample_fraction < 1);            // estimate the GDVs rather than count them?
+        auto do_cache = (cache_dir != "" && !do_sample);   // look up and store GDVs in the cache?
+        auto do_update = (update_fraction > 0 && !do_sample); // update H's GDVs from G's when they are close?
 
         const auto BASE_PATH = "alignments";
         const auto LOG_FILENAME = "log.txt";
@@ -58,6 +91,7 @@ int main(int argc, char *argv[])
         const auto OVERALL_COSTS_FILENAME = "overall_costs.csv";
         const auto ALIGNMENT_MATRIX_FILENAME = "alignment_matrix.csv";
         const auto ALIGNMENT_LIST_FILENAME = "alignment_list.csv";
+        const auto SAMPLE_SEED = 1ULL; // random seed for GDV estimates, fixed so that runs are repeatable
 
         // Generate output names
         auto g_name = FileIO::name_file(g_file, g_alias);
@@ -83,6 +117,17 @@ int main(int argc, char *argv[])
         FileIO::out(log, "Alpha:                " + Util::to_string(alpha, 3) + "\n");
         FileIO::out(log, "Beta:                 " + Util::to_string(beta, 3) + "\n");
         FileIO::out(log, "Similarity threshold: " + Util::to_string(similarity_threshold, 3) + "\n");
+        FileIO::out(log, "Threads:              " + args[14] + "\n");
+        FileIO::out(log, "GDV engine:           " + args[15] + "\n");
+        FileIO::out(log, "GDV node order:       " + args[16] + "\n");
+        FileIO::out(log, "Graphlet size:        " + args[18] + "\n");
+        FileIO::out(log, "Similarity metric:    " + args[22] + "\n");
+        if (args[23] != "") FileIO::out(log, "Compared orbits:      " + args[23] + "\n");
+        FileIO::out(log, "Solver:               " + args[24] + "\n");
+        if (warm_file != "") FileIO::out(log, "Warm start file:      " + warm_file + "\n");
+        if (do_sample) FileIO::out(log, "GDV sample fraction:  " + args[19] + "\n");
+        if (do_cache) FileIO::out(log, "GDV cache:            " + cache_dir + "\n");
+        if (do_update) FileIO::out(log, "GDV update limit:     " + args[26] + "\n");
         FileIO::out(log, "\n");
 
         FileIO::out(log, "BEGINNING ALIGNMENT\n");
@@ -113,26 +158,87 @@ int main(int argc, char *argv[])
             FileIO::out(log, "done. (" + std::to_string(d01) + "ms)\n");
         }
 
-        // Calculate the GDVs for G and H, remove temp files
+        // Calculate the GDVs for G and H
         FileIO::out(log, "Calculating GDVs...............................");
         auto s10 = std::chrono::high_resolution_clock::now();
-        auto g_gc_file = FileIO::graphcrunch_in(g_file, directory + g_name);
-        auto h_gc_file = FileIO::graphcrunch_in(h_file, directory + h_name);
-        auto g_gdvs = GraphCrunch::graphcrunch(g_gc_file);
-        auto h_gdvs = GraphCrunch::graphcrunch(h_gc_file);
-        std::string rm1 = directory + g_name + "_gc.csv";
-        remove(rm1.c_str());
-        std::string rm2 = directory + h_name + "_gc.csv";
-        remove(rm2.c_str());
+        auto g_csr = GraphCrunch::to_csr(g_graph);
+        auto h_csr = GraphCrunch::to_csr(h_graph);
+        GraphCrunch::GdvMatrix g_margins;
+        GraphCrunch::GdvMatrix h_margins;
+        std::string h_source; // how H's GDVs were found, with -update
+        auto gdvs_of = [&](const GraphCrunch::CsrGraph &csr, const GraphCrunch::CsrGraph *base, const GraphCrunch::GdvMatrix *base_gdvs,
+                           GraphCrunch::GdvMatrix &margins)
+        {
+            GraphCrunch::GdvMatrix gdvs;
+            if (do_sample)
+            {
+                return GraphCrunch::estimate(csr, threads, order, graphlet_size, sample_fraction, SAMPLE_SEED, margins);
+            }
+
+            // The GDVs depend only on the edge set and graphlet size, so look them up by those
+            unsigned long long key = 0;
+            std::string cache_file;
+            if (do_cache)
+            {
+                key = GraphCrunch::fingerprint(csr);
+                cache_file = FileIO::gdv_cache_path(cache_dir, key, GraphCrunch::gdv_length(graphlet_size));
+                if (FileIO::cache_to_gdvs(cache_file, key, csr.V, GraphCrunch::gdv_length(graphlet_size), gdvs))
+                {
+                    if (base) h_source = "found in the GDV cache";
+                    return gdvs;
+                }
+            }
+
+            // With -update, H's GDVs are updated from G's, node i of G taken as node i of H, when the graphs
+            // are the same size and differ by at most the given fraction of H's edges
+            if (base && base->V == csr.V)
+            {
+                std::vector<std::pair<int, int>> added;
+                std::vector<std::pair<int, int>> removed;
+                GraphCrunch::edge_changes(*base, csr, added, removed);
+                auto changes = added.size() + removed.size();
+                auto limit = (size_t)(update_fraction * csr.adj.size() / 2);
+                if (changes <= limit)
+                {
+                    h_source = "updated from G's for " + std::to_string(changes) + " edge changes";
+                    gdvs = GraphCrunch::update(*base, *base_gdvs, added, removed, graphlet_size);
+                }
+                else
+                {
+                    h_source = "recounted, as their " + std::to_string(changes) + " edge changes from G exceed the limit of " +
+                               std::to_string(limit);
+                    gdvs = GraphCrunch::count(csr, threads, engine, order, graphlet_size);
+                }
+            }
+            else
+            {
+                if (base) h_source = "recounted, as G and H differ in size";
+                gdvs = GraphCrunch::count(csr, threads, engine, order, graphlet_size);
+            }
+
+            if (do_cache)
+            {
+                FileIO::gdvs_to_cache(cache_file, key, gdvs);
+            }
+            return gdvs;
+        };
+        auto g_gdvs = gdvs_of(g_csr, nullptr, nullptr, g_margins);
+        auto h_gdvs = gdvs_of(h_csr, do_update ? &g_csr : nullptr, &g_gdvs, h_margins);
         auto f10 = std::chrono::high_resolution_clock::now();
         auto d10 = std::chrono::duration_cast<std::chrono::milliseconds>(f10 - s10).count();
         FileIO::out(log, "done. (" + std::to_string(d10) + "ms)\n");
+        if (do_update) FileIO::out(log, "  H's GDVs were " + h_source + "\n");
 
         // Writing GDVs to files
         FileIO::out(log, "Writing GDVs to files..........................");
         auto s11 = std::chrono::high_resolution_clock::now();
         FileIO::gdvs_to_file(directory + g_name + "_gdvs.csv", g_labels, g_gdvs);
         FileIO::gdvs_to_file(directory + h_name + "_gdvs.csv", h_labels, h_gdvs);
+        if (do_sample)
+        {
+            FileIO::gdvs_to_file(directory + g_name + "_gdvs_ci.csv", g_labels, g_margins);
+            FileIO::gdvs_to_file(directory + h_name + "_gdvs_ci.csv", h_labels, h_margins);
+        }
         auto f11 = std::chrono::high_resolution_clock::now();
         auto d11 = std::chrono::duration_cast<std::chrono::milliseconds>(f11 - s11).count();
         FileIO::out(log, "done. (" + std::to_string(d11) + "ms)\n");
@@ -140,7 +246,11 @@ int main(int argc, char *argv[])
         // Calculate the topological similarity matrix
         FileIO::out(log, "Calculating the topological cost matrix........");
         auto s20 = std::chrono::high_resolution_clock::now();
-        auto topological_costs = GDVs_Dist::gdvs_dist(g_gdvs, h_gdvs, alpha);
+        // The costs are calculated as they are needed; with candidates, the pairs left out are given the maximum cost
+        Util::SparseCostMatrix candidate_costs;
+        if (knn > 0) candidate_costs = GDVs_Dist::candidates(g_gdvs, h_gdvs, alpha, measure, knn, threads);
+        auto topological_costs = (knn > 0) ? Util::provider(candidate_costs)
+                                           : GDVs_Dist::provider(g_gdvs, h_gdvs, alpha, measure, threads);
         auto f20 = std::chrono::high_resolution_clock::now();
         auto d20 = std::chrono::duration_cast<std::chrono::milliseconds>(f20 - s20).count();
         FileIO::out(log, "done. (" + std::to_string(d20) + "ms)\n");
@@ -155,6 +265,10 @@ int main(int argc, char *argv[])
 
         std::vector<std::vector<double>> alignment;
 
+        // Start the solver from the state of an earlier run on graphs the same size, if there is one
+        Util::WarmStart warm;
+        if (warm_file != "") FileIO::file_to_warm_start(warm_file, topological_costs.rows, topological_costs.cols, warm);
+
         if (do_bio) // incorporate biological data
         {
             // Parse and normalize the biological cost matrix
@@ -207,7 +321,9 @@ int main(int argc, char *argv[])
             FileIO::out(log, "Aligning the graphs............................");
             std::cout << std::endl; // PROGRESS
             auto s50 = std::chrono::high_resolution_clock::now();
-            alignment = Hungarian::hungarian(overall_costs);
+            alignment = (solver == Hungarian::SPARSE_JONKER_VOLGENANT)
+                            ? Hungarian::hungarian(Util::combine(candidate_costs, biological_costs, beta))
+                            : Hungarian::hungarian(overall_costs, precision, solver, threads, warm);
             auto f50 = std::chrono::high_resolution_clock::now();
             auto d50 = std::chrono::duration_cast<std::chrono::milliseconds>(f50 - s50).count();
             std::cout << "\33[2K\r"; // PROGRESS
@@ -219,13 +335,21 @@ int main(int argc, char *argv[])
             FileIO::out(log, "Aligning the graphs............................");
             std::cout << std::endl; // PROGRESS
             auto s50 = std::chrono::high_resolution_clock::now();
-            alignment = Hungarian::hungarian(topological_costs);
+            alignment = (solver == Hungarian::SPARSE_JONKER_VOLGENANT)
+                            ? Hungarian::hungarian(candidate_costs)
+                            : Hungarian::hungarian(topological_costs, precision, solver, threads, warm);
             auto f50 = std::chrono::high_resolution_clock::now();
             auto d50 = std::chrono::duration_cast<std::chrono::milliseconds>(f50 - s50).count();
             std::cout << "\33[2K\r"; // PROGRESS
             FileIO::out(log, "done. (" + std::to_string(d50) + "ms)\n");
         }
 
+        // Keep the solver's state for the next run
+        if (warm_file != "" && warm.rows != 0)
+        {
+            FileIO::warm_start_to_file(warm_file, warm);
+        }
+
         // Write the alignment to csv files
         FileIO::out(log, "Writing the alignment to file..................");
         auto s51 = std::chrono::high_resolution_clock::now();
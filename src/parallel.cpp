@@ -0,0 +1,173 @@
+// parallel.cpp
+// Work-Stealing Loop Scheduler
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+
+namespace Parallel
+{
+    /*
+     * The range of loop indices still owned by one worker.
+     */
+    struct Range
+    {
+        std::mutex lock;
+        unsigned lo = 0;
+        unsigned hi = 0;
+    };
+
+    /**
+     * Resolve the requested number of worker threads.
+     *
+     * @param requested The number of threads asked for, or 0 for one per hardware thread.
+     *
+     * @return The number of threads to use, at least 1.
+     */
+    unsigned resolve_threads(unsigned requested)
+    {
+        if (requested == 0)
+        {
+            requested = std::thread::hardware_concurrency();
+        }
+
+        return std::max(1u, requested);
+    }
+
+    /*
+     * Take the next chunk off the front of the given range. Returns false if the range is empty.
+     */
+    bool pop_front(Range &range, unsigned chunk, unsigned &begin, unsigned &end)
+    {
+        std::lock_guard<std::mutex> guard(range.lock);
+        if (range.lo >= range.hi)
+        {
+            return false;
+        }
+
+        begin = range.lo;
+        end = std::min(range.lo + chunk, range.hi);
+        range.lo = end;
+        return true;
+    }
+
+    /*
+     * Move the back half of the victim's range into the thief's (empty) range.
+     */
+    bool steal(Range &victim, Range &thief)
+    {
+        unsigned lo;
+        unsigned hi;
+        {
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (victim.lo >= victim.hi)
+            {
+                return false;
+            }
+
+            lo = victim.lo + (victim.hi - victim.lo) / 2;
+            hi = victim.hi;
+            victim.hi = lo;
+        }
+
+        std::lock_guard<std::mutex> guard(thief.lock);
+        thief.lo = lo;
+        thief.hi = hi;
+        return true;
+    }
+
+    /**
+     * Run fn over the indices [0, n) on the given number of threads.
+     * Each worker starts with a contiguous block of the indices and works through it in chunks;
+     * a worker whose block is exhausted steals the back half of another worker's remaining block.
+     *
+     * @param n The number of loop indices.
+     * @param chunk The number of indices handed to fn per call.
+     * @param threads The number of worker threads (already resolved).
+     * @param fn Called as fn(worker, begin, end) for disjoint ranges covering [0, n).
+     *
+     * @throws The first exception thrown by fn, after all workers have stopped.
+     */
+    void for_chunks(unsigned n, unsigned chunk, unsigned threads, std::function<void(unsigned, unsigned, unsigned)> fn)
+    {
+        chunk = std::max(1u, chunk);
+        threads = std::max(1u, std::min(threads, (n + chunk - 1) / chunk));
+
+        if (threads == 1)
+        {
+            if (n > 0)
+            {
+                fn(0, 0, n);
+            }
+            return;
+        }
+
+        // Split the indices into contiguous blocks, one per worker
+        std::unique_ptr<Range[]> ranges(new Range[threads]);
+        for (unsigned w = 0; w < threads; ++w)
+        {
+            ranges[w].lo = (unsigned)((unsigned long long)n * w / threads);
+            ranges[w].hi = (unsigned)((unsigned long long)n * (w + 1) / threads);
+        }
+
+        std::mutex error_lock;
+        std::exception_ptr error;
+
+        auto work = [&](unsigned w)
+        {
+            try
+            {
+                unsigned begin;
+                unsigned end;
+                while (true)
+                {
+                    while (pop_front(ranges[w], chunk, begin, end))
+                    {
+                        fn(w, begin, end);
+                    }
+
+                    // Out of local work; try to steal from the other workers in turn
+                    bool stolen = false;
+                    for (unsigned v = 1; v < threads && !stolen; ++v)
+                    {
+                        stolen = steal(ranges[(w + v) % threads], ranges[w]);
+                    }
+                    if (!stolen)
+                    {
+                        return;
+                    }
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(error_lock);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (unsigned w = 1; w < threads; ++w)
+        {
+            pool.emplace_back(work, w);
+        }
+        work(0);
+        for (auto &t : pool)
+        {
+            t.join();
+        }
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
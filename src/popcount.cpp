@@ -0,0 +1,200 @@
+// popcount.cpp
+// Bit Row Intersection Counting
+
+#include <cstddef>
+
+#include "popcount.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define POPCOUNT_X86 1
+#endif
+
+namespace Popcount
+{
+    /*
+     * Portable versions; __builtin_popcountll compiles to whatever the baseline target has.
+     */
+    unsigned long long and_count_scalar(const unsigned long long *a, const unsigned long long *b, unsigned words)
+    {
+        unsigned long long count = 0;
+        for (unsigned k = 0; k < words; k++)
+        {
+            count += __builtin_popcountll(a[k] & b[k]);
+        }
+        return count;
+    }
+
+    unsigned long long and3_count_scalar(const unsigned long long *a, const unsigned long long *b,
+                                         const unsigned long long *c, unsigned words)
+    {
+        unsigned long long count = 0;
+        for (unsigned k = 0; k < words; k++)
+        {
+            count += __builtin_popcountll(a[k] & b[k] & c[k]);
+        }
+        return count;
+    }
+
+#ifdef POPCOUNT_X86
+    /*
+     * The same loops compiled with the POPCNT instruction.
+     */
+    __attribute__((target("popcnt"))) unsigned long long and_count_popcnt(const unsigned long long *a, const unsigned long long *b,
+                                                                          unsigned words)
+    {
+        unsigned long long count = 0;
+        for (unsigned k = 0; k < words; k++)
+        {
+            count += __builtin_popcountll(a[k] & b[k]);
+        }
+        return count;
+    }
+
+    __attribute__((target("popcnt"))) unsigned long long and3_count_popcnt(const unsigned long long *a, const unsigned long long *b,
+                                                                           const unsigned long long *c, unsigned words)
+    {
+        unsigned long long count = 0;
+        for (unsigned k = 0; k < words; k++)
+        {
+            count += __builtin_popcountll(a[k] & b[k] & c[k]);
+        }
+        return count;
+    }
+
+    /*
+     * AVX2 has no vector popcount: count the bits of each nibble with a table lookup (pshufb),
+     * then add up the bytes of every 64-bit lane with psadbw (Mula, Kurz and Lemire 2018).
+     */
+    __attribute__((target("avx2"))) inline __m256i popcount_avx2(__m256i v)
+    {
+        const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                               0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+
+        __m256i low = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low_nibbles));
+        __m256i high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles));
+        return _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256());
+    }
+
+    __attribute__((target("avx2"))) inline unsigned long long sum_avx2(__m256i v)
+    {
+        return (unsigned long long)_mm256_extract_epi64(v, 0) + (unsigned long long)_mm256_extract_epi64(v, 1) +
+               (unsigned long long)_mm256_extract_epi64(v, 2) + (unsigned long long)_mm256_extract_epi64(v, 3);
+    }
+
+    __attribute__((target("avx2,popcnt"))) unsigned long long and_count_avx2(const unsigned long long *a, const unsigned long long *b,
+                                                                             unsigned words)
+    {
+        __m256i sum = _mm256_setzero_si256();
+        unsigned k = 0;
+        for (; k + 4 <= words; k += 4)
+        {
+            __m256i x = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(a + k)), _mm256_loadu_si256((const __m256i *)(b + k)));
+            sum = _mm256_add_epi64(sum, popcount_avx2(x));
+        }
+
+        unsigned long long count = sum_avx2(sum);
+        for (; k < words; k++)
+        {
+            count += __builtin_popcountll(a[k] & b[k]);
+        }
+        return count;
+    }
+
+    __attribute__((target("avx2,popcnt"))) unsigned long long and3_count_avx2(const unsigned long long *a, const unsigned long long *b,
+                                                                              const unsigned long long *c, unsigned words)
+    {
+        __m256i sum = _mm256_setzero_si256();
+        unsigned k = 0;
+        for (; k + 4 <= words; k += 4)
+        {
+            __m256i x = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(a + k)), _mm256_loadu_si256((const __m256i *)(b + k)));
+            x = _mm256_and_si256(x, _mm256_loadu_si256((const __m256i *)(c + k)));
+            sum = _mm256_add_epi64(sum, popcount_avx2(x));
+        }
+
+        unsigned long long count = sum_avx2(sum);
+        for (; k < words; k++)
+        {
+            count += __builtin_popcountll(a[k] & b[k] & c[k]);
+        }
+        return count;
+    }
+
+    /*
+     * AVX-512 with the VPOPCNTDQ extension counts the bits of eight words per instruction;
+     * the tail is handled with a masked load.
+     */
+    __attribute__((target("avx512f"))) inline unsigned long long sum_avx512(__m512i v)
+    {
+        alignas(64) unsigned long long lanes[8];
+        _mm512_store_si512(lanes, v);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+    }
+
+    __attribute__((target("avx512f,avx512vpopcntdq"))) unsigned long long and_count_avx512(const unsigned long long *a,
+                                                                                           const unsigned long long *b,
+                                                                                           unsigned words)
+    {
+        __m512i sum = _mm512_setzero_si512();
+        for (unsigned k = 0; k < words; k += 8)
+        {
+            __mmask8 mask = (words - k >= 8) ? 0xff : (__mmask8)((1u << (words - k)) - 1);
+            __m512i x = _mm512_and_si512(_mm512_maskz_loadu_epi64(mask, a + k), _mm512_maskz_loadu_epi64(mask, b + k));
+            sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(x));
+        }
+        return sum_avx512(sum);
+    }
+
+    __attribute__((target("avx512f,avx512vpopcntdq"))) unsigned long long and3_count_avx512(const unsigned long long *a,
+                                                                                            const unsigned long long *b,
+                                                                                            const unsigned long long *c,
+                                                                                            unsigned words)
+    {
+        __m512i sum = _mm512_setzero_si512();
+        for (unsigned k = 0; k < words; k += 8)
+        {
+            __mmask8 mask = (words - k >= 8) ? 0xff : (__mmask8)((1u << (words - k)) - 1);
+            __m512i x = _mm512_and_si512(_mm512_maskz_loadu_epi64(mask, a + k), _mm512_maskz_loadu_epi64(mask, b + k));
+            x = _mm512_and_si512(x, _mm512_maskz_loadu_epi64(mask, c + k));
+            sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(x));
+        }
+        return sum_avx512(sum);
+    }
+#endif
+
+    /**
+     * Pick the fastest kernels the CPU we are running on supports.
+     *
+     * @return The kernels, and the name of the instruction set they use.
+     */
+    Kernels select_kernels()
+    {
+#ifdef POPCOUNT_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq"))
+        {
+            return Kernels{and_count_avx512, and3_count_avx512, "avx512"};
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        {
+            return Kernels{and_count_avx2, and3_count_avx2, "avx2"};
+        }
+        if (__builtin_cpu_supports("popcnt"))
+        {
+            return Kernels{and_count_popcnt, and3_count_popcnt, "popcnt"};
+        }
+#endif
+        return Kernels{and_count_scalar, and3_count_scalar, "scalar"};
+    }
+
+    /**
+     * The kernels for this CPU, selected on first use.
+     */
+    const Kernels &kernels()
+    {
+        static const Kernels selected = select_kernels();
+        return selected;
+    }
+}
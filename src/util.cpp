@@ -1,11 +1,16 @@
 #include <algorithm>
 #include <ctime>
+#include <functional>
 #include <iostream>
 #include <iomanip>
 #include <limits>
+#include <memory>
 #include <sstream>
+#include <type_traits>
 #include <vector>
 
+#include "graphcrunch.h"
+#include "util.h"
 #include "file_io.h"
 
 namespace Util
@@ -58,6 +63,19 @@ namespace Util
      * args[9]:  do a passthrough?
      * args[10]: include a timestamp?
      * args[11]: include a greekstamp?
+     * args[14]: number of threads (0 for one per hardware thread)
+     * args[15]: GDV counting engine
+     * args[16]: node order for GDV counting
+     * args[17]: GDV cache directory (empty for no cache)
+     * args[18]: largest graphlet size counted in the GDVs
+     * args[19]: fraction of the 4 node subgraphs sampled to estimate the GDVs (1 for exact GDVs)
+     * args[20]: number of candidate H nodes kept per G node (0 for all of them)
+     * args[21]: precision the assignment solver holds its working copy of the costs in
+     * args[22]: node similarity metric
+     * args[23]: GDV orbits the metric compares (empty for all of them)
+     * args[24]: assignment solver (sparse needs candidates, args[20] > 0)
+     * args[25]: file the solver's state is kept in between runs (empty for none; needs the jv solver)
+     * args[26]: most edge changes from G, as a fraction of H's edges, for which H's GDVs are updated from G's (0 for never)
      *
      * @param argc The number of command line arguments.
      * @param argv The command line arguments.
@@ -68,9 +86,9 @@ namespace Util
      */
     std::vector<std::string> parse_args(int argc, char *argv[])
     {
-        std::vector<std::string> args = {"", "", "", "", "1", "1", "0", "", "", "", "0", "0", "0", "0"};
+        std::vector<std::string> args = {"", "", "", "", "1", "1", "0", "", "", "", "0", "0", "0", "0", "1", "enum", "input", "", "5", "1", "0", "double", "graal", "", "munkres", "", "0"};
 
-        if (argc < 3 || argc > 14)
+        if (argc < 3 || argc > 27)
         {
             throw std::invalid_argument("Invalid number of arguments.\nUsage: ./minaaa.exe <G.csv> <H.csv> \nSee README.md for additional options and details.");
         }
@@ -147,6 +165,108 @@ namespace Util
                     throw std::invalid_argument("The B alias contains an illegal character.");
                 }
             }
+            else if (arg.find("-threads=") != std::string::npos)
+            {
+                args[14] = arg.substr(9);
+                if (args[14].empty() || args[14].find_first_not_of("0123456789") != std::string::npos)
+                {
+                    throw std::invalid_argument("The threads argument must be a non-negative integer.");
+                }
+            }
+            else if (arg.find("-engine=") != std::string::npos)
+            {
+                args[15] = arg.substr(8);
+                if (args[15] != "enum" && args[15] != "orca" && args[15] != "esu")
+                {
+                    throw std::invalid_argument("The engine argument must be one of: enum, orca, esu.");
+                }
+            }
+            else if (arg.find("-order=") != std::string::npos)
+            {
+                args[16] = arg.substr(7);
+                if (args[16] != "input" && args[16] != "degree" && args[16] != "rcm")
+                {
+                    throw std::invalid_argument("The order argument must be one of: input, degree, rcm.");
+                }
+            }
+            else if (arg.find("-cache=") != std::string::npos)
+            {
+                args[17] = arg.substr(7);
+                if (args[17].empty())
+                {
+                    throw std::invalid_argument("The cache argument must be a directory path.");
+                }
+            }
+            else if (arg.find("-sample=") != std::string::npos)
+            {
+                args[19] = arg.substr(8);
+                if (std::stod(args[19]) <= 0 || std::stod(args[19]) > 1)
+                {
+                    throw std::invalid_argument("The sample argument must be in range (0, 1].");
+                }
+            }
+            else if (arg.find("-gs=") != std::string::npos)
+            {
+                args[18] = arg.substr(4);
+                if (args[18] != "3" && args[18] != "4" && args[18] != "5")
+                {
+                    throw std::invalid_argument("The graphlet size argument must be one of: 3, 4, 5.");
+                }
+            }
+            else if (arg.find("-knn=") != std::string::npos)
+            {
+                args[20] = arg.substr(5);
+                if (args[20].empty() || args[20].find_first_not_of("0123456789") != std::string::npos)
+                {
+                    throw std::invalid_argument("The knn argument must be a non-negative integer.");
+                }
+            }
+            else if (arg.find("-precision=") != std::string::npos)
+            {
+                args[21] = arg.substr(11);
+                if (args[21] != "double" && args[21] != "float" && args[21] != "fixed16")
+                {
+                    throw std::invalid_argument("The precision argument must be one of: double, float, fixed16.");
+                }
+            }
+            else if (arg.find("-metric=") != std::string::npos)
+            {
+                args[22] = arg.substr(8);
+                if (args[22] != "graal" && args[22] != "cosine" && args[22] != "agreement" && args[22] != "l1")
+                {
+                    throw std::invalid_argument("The metric argument must be one of: graal, cosine, agreement, l1.");
+                }
+            }
+            else if (arg.find("-orbits=") != std::string::npos)
+            {
+                args[23] = arg.substr(8);
+                parse_orbits(args[23]);
+            }
+            else if (arg.find("-solver=") != std::string::npos)
+            {
+                args[24] = arg.substr(8);
+                if (args[24] != "munkres" && args[24] != "jv" && args[24] != "sparse" && args[24] != "auction" &&
+                    args[24] != "auction-exact")
+                {
+                    throw std::invalid_argument("The solver argument must be one of: munkres, jv, sparse, auction, auction-exact.");
+                }
+            }
+            else if (arg.find("-warm=") != std::string::npos)
+            {
+                args[25] = arg.substr(6);
+                if (args[25].empty())
+                {
+                    throw std::invalid_argument("The warm argument must be a file path.");
+                }
+            }
+            else if (arg.find("-update=") != std::string::npos)
+            {
+                args[26] = arg.substr(8);
+                if (std::stod(args[26]) < 0 || std::stod(args[26]) > 1)
+                {
+                    throw std::invalid_argument("The update argument must be in range [0, 1].");
+                }
+            }
             else if (arg.find("-p") != std::string::npos)
             {
                 args[10] = "1";
@@ -169,9 +289,73 @@ namespace Util
             }
         }
 
+        if (args[24] == "sparse" && args[20] == "0")
+        {
+            throw std::invalid_argument("The sparse solver needs candidates; set knn to a positive integer.");
+        }
+        if (args[25] != "" && args[24] != "jv")
+        {
+            throw std::invalid_argument("The warm start needs the jv solver; set solver=jv.");
+        }
+
         return args;
     }
 
+    /**
+     * Parse a list of GDV orbits, such as "0-14,20", into the orbits it names.
+     *
+     * @param list Comma separated orbits and inclusive ranges of orbits, in range [0, 72].
+     *
+     * @return The orbits, in increasing order and without repeats.
+     *
+     * @throws std::invalid_argument if the list is misformatted or names no orbit.
+     */
+    std::vector<unsigned> parse_orbits(std::string list)
+    {
+        const std::string ERROR = "The orbits argument must list orbits in range [0, 72], such as 0-14,20.";
+
+        std::vector<bool> named(73, false);
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            auto dash = item.find('-');
+            std::string first = item.substr(0, dash);
+            std::string last = (dash == std::string::npos) ? first : item.substr(dash + 1);
+            if (first.empty() || last.empty() || (first + last).find_first_not_of("0123456789") != std::string::npos ||
+                first.size() > 2 || last.size() > 2)
+            {
+                throw std::invalid_argument(ERROR);
+            }
+
+            unsigned lo = std::stoul(first);
+            unsigned hi = std::stoul(last);
+            if (lo > hi || hi > 72)
+            {
+                throw std::invalid_argument(ERROR);
+            }
+            for (unsigned i = lo; i <= hi; ++i)
+            {
+                named[i] = true;
+            }
+        }
+
+        std::vector<unsigned> orbits;
+        for (unsigned i = 0; i < 73; ++i)
+        {
+            if (named[i])
+            {
+                orbits.push_back(i);
+            }
+        }
+        if (orbits.empty())
+        {
+            throw std::invalid_argument(ERROR);
+        }
+
+        return orbits;
+    }
+
     /**
      * Parse the given double matrix into a binary matrix.
      *
@@ -282,45 +466,184 @@ namespace Util
         return one_minus_matrix;
     }
 
+    // Most memory the rows cached by a cost provider take
+    const size_t COST_CACHE_BYTES = 16 << 20;
+
+    // Most rows a cost provider calculates at once
+    const unsigned COST_BAND_ROWS = 256;
+
+    /**
+     * Set up a cost provider with a band size and cache that fit in COST_CACHE_BYTES.
+     *
+     * @param rows The number of rows of the cost matrix.
+     * @param cols The number of columns of the cost matrix.
+     * @param fill_rows Writes the costs of a range of rows to a buffer, back to back.
+     * @param cost Calculates a single cost.
+     */
+    CostProvider::CostProvider(unsigned rows, unsigned cols, std::function<void(unsigned, unsigned, double *)> fill_rows,
+                               std::function<double(unsigned, unsigned)> cost)
+        : rows(rows), cols(cols), fill_rows(fill_rows), cost(cost)
+    {
+        size_t row_bytes = std::max<size_t>(1, (size_t)cols * sizeof(double));
+        band_rows = (unsigned)std::clamp<size_t>(COST_CACHE_BYTES / 4 / row_bytes, 1, COST_BAND_ROWS);
+        cache_bands = (unsigned)std::max<size_t>(1, COST_CACHE_BYTES / (band_rows * row_bytes));
+    }
+
+    /**
+     * Get a row of costs, calculating its band of rows first if it is not in the cache.
+     *
+     * @param i The row.
+     *
+     * @return The costs of row i, valid until the next call.
+     */
+    const double *CostProvider::row(unsigned i)
+    {
+        unsigned begin = i - i % band_rows;
+        ++uses;
+
+        Band *lru = nullptr;
+        for (auto &band : cache)
+        {
+            if (band.begin == begin && !band.values.empty())
+            {
+                band.used = uses;
+                return band.values.data() + (size_t)(i - begin) * cols;
+            }
+            if (lru == nullptr || band.used < lru->used)
+            {
+                lru = &band;
+            }
+        }
+
+        // Calculate the band into a free slot, or in place of the least recently used band
+        if (cache.size() < cache_bands)
+        {
+            cache.emplace_back();
+            lru = &cache.back();
+        }
+        unsigned end = std::min(begin + band_rows, rows);
+        lru->begin = begin;
+        lru->used = uses;
+        lru->values.resize((size_t)(end - begin) * cols);
+        fill_rows(begin, end, lru->values.data());
+
+        return lru->values.data() + (size_t)(i - begin) * cols;
+    }
+
+    /**
+     * Provide the costs of a sparse cost matrix, with the unlisted pairs at the maximum cost.
+     *
+     * @param sparse The sparse cost matrix.
+     *
+     * @return The costs.
+     */
+    CostProvider provider(const SparseCostMatrix &sparse)
+    {
+        auto matrix = std::make_shared<const SparseCostMatrix>(sparse);
+        auto fill_rows = [matrix](unsigned begin, unsigned end, double *out)
+        {
+            std::fill(out, out + (size_t)(end - begin) * matrix->cols, 1);
+            for (unsigned i = begin; i < end; ++i)
+            {
+                double *row = out + (size_t)(i - begin) * matrix->cols;
+                for (size_t e = matrix->offsets[i]; e < matrix->offsets[i + 1]; ++e)
+                {
+                    row[matrix->indices[e]] = matrix->values[e];
+                }
+            }
+        };
+        auto cost = [matrix](unsigned i, unsigned j)
+        {
+            auto first = matrix->indices.begin() + matrix->offsets[i];
+            auto last = matrix->indices.begin() + matrix->offsets[i + 1];
+            auto it = std::lower_bound(first, last, j);
+            return (it != last && *it == j) ? matrix->values[it - matrix->indices.begin()] : 1.0;
+        };
+
+        return CostProvider(sparse.rows, sparse.cols, fill_rows, cost);
+    }
+
     /**
-     * Combine the topological and biological cost matrices.
+     * Combine the topological and biological cost matrices, as their costs are asked for.
      *
      * @param topological_costs The topological cost matrix.
-     * @param biological_costs The biological cost matrix.
+     * @param biological_costs The biological cost matrix; it must outlive the combined costs.
      * @param beta of the weight goes to topological similarity, (1 - beta) goes to biological similarity.
      *
      * @return The combined cost matrix.
      *
      * @throws
      */
-    std::vector<std::vector<double>> combine(
-        std::vector<std::vector<double>> topological_costs, std::vector<std::vector<double>> biological_costs, double beta)
+    CostProvider combine(const CostProvider &topological_costs, const std::vector<std::vector<double>> &biological_costs, double beta)
     {
         // Handle absent biological costs
         if (biological_costs.empty())
         {
-            return topological_costs;
+            return CostProvider(topological_costs.rows, topological_costs.cols, topological_costs.fill_rows, topological_costs.cost);
         }
         // Handle invalid beta
         if (beta < 0 || beta > 1)
         {
             std::cerr << "Beta must be between 0 and 1. Defaulting to beta = 1." << std::endl;
-            return topological_costs;
+            return CostProvider(topological_costs.rows, topological_costs.cols, topological_costs.fill_rows, topological_costs.cost);
         }
 
-        std::vector<std::vector<double>> overall_costs;
+        unsigned cols = topological_costs.cols;
+        auto top_fill_rows = topological_costs.fill_rows;
+        auto top_cost = topological_costs.cost;
+        auto fill_rows = [top_fill_rows, cols, &biological_costs, beta](unsigned begin, unsigned end, double *out)
+        {
+            top_fill_rows(begin, end, out);
+            for (unsigned i = begin; i < end; ++i)
+            {
+                double *row = out + (size_t)(i - begin) * cols;
+                for (unsigned j = 0; j < cols; ++j)
+                {
+                    row[j] = beta * row[j] + (1 - beta) * biological_costs[i][j];
+                }
+            }
+        };
+        auto cost = [top_cost, &biological_costs, beta](unsigned i, unsigned j)
+        {
+            return beta * top_cost(i, j) + (1 - beta) * biological_costs[i][j];
+        };
+
+        return CostProvider(topological_costs.rows, cols, fill_rows, cost);
+    }
 
-        for (unsigned i = 0; i < topological_costs.size(); ++i)
+    /**
+     * Combine the topological costs of the candidate pairs with their biological costs.
+     * The pairs that are not candidates stay unlisted.
+     *
+     * @param topological_costs The topological costs of the candidate pairs.
+     * @param biological_costs The biological cost matrix.
+     * @param beta of the weight goes to topological similarity, (1 - beta) goes to biological similarity.
+     *
+     * @return The combined costs of the candidate pairs.
+     */
+    SparseCostMatrix combine(const SparseCostMatrix &topological_costs, const std::vector<std::vector<double>> &biological_costs, double beta)
+    {
+        SparseCostMatrix combined = topological_costs;
+
+        // Handle absent biological costs, and invalid beta
+        if (biological_costs.empty())
         {
-            std::vector<double> row;
-            for (unsigned j = 0; j < topological_costs[i].size(); ++j)
+            return combined;
+        }
+        if (beta < 0 || beta > 1)
+        {
+            std::cerr << "Beta must be between 0 and 1. Defaulting to beta = 1." << std::endl;
+            return combined;
+        }
+
+        for (unsigned i = 0; i < combined.rows; ++i)
+        {
+            for (size_t e = combined.offsets[i]; e < combined.offsets[i + 1]; ++e)
             {
-                row.push_back(beta * topological_costs[i][j] + (1 - beta) * biological_costs[i][j]);
+                combined.values[e] = beta * combined.values[e] + (1 - beta) * biological_costs[i][combined.indices[e]];
             }
-            overall_costs.push_back(row);
         }
 
-        return overall_costs;
+        return combined;
     }
-
 }
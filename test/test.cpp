@@ -0,0 +1,441 @@
+// test.cpp
+// Cross-Checks of the GDV Engines and Assignment Solvers
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "util.h"
+#include "hungarian.h"
+#include "graphcrunch.h"
+#include "file_io.h"
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool ok, std::string what)
+    {
+        if (!ok)
+        {
+            std::cout << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    /*
+     * A random graph on n nodes with each edge present with probability p, as a binary
+     * adjacency matrix.
+     */
+    std::vector<std::vector<unsigned>> random_graph(unsigned n, double p, std::mt19937 &rng)
+    {
+        std::bernoulli_distribution edge(p);
+        std::vector<std::vector<unsigned>> graph(n, std::vector<unsigned>(n, 0));
+        for (unsigned i = 0; i < n; ++i)
+        {
+            for (unsigned j = i + 1; j < n; ++j)
+            {
+                graph[i][j] = graph[j][i] = edge(rng);
+            }
+        }
+        return graph;
+    }
+
+    /*
+     * A GDV engine against brute force enumeration on one thread, for every graphlet size and
+     * on 1 and 3 threads.
+     */
+    void test_engine(GraphCrunch::Engine engine, std::string name)
+    {
+        struct Case
+        {
+            unsigned n;
+            double p;
+        };
+        // Sparse enough that count skips the row intersections, dense, and one in between
+        const Case cases[] = {{200, 0.015}, {40, 0.5}, {90, 0.08}};
+
+        std::mt19937 rng(11);
+        for (const Case &c : cases)
+        {
+            auto csr = GraphCrunch::to_csr(random_graph(c.n, c.p, rng));
+            for (int gs = 3; gs <= 5; ++gs)
+            {
+                auto expected = GraphCrunch::count(csr, 1, GraphCrunch::ENUMERATE, GraphCrunch::INPUT_ORDER, gs);
+                for (unsigned threads : {1u, 3u})
+                {
+                    check(GraphCrunch::count(csr, threads, engine, GraphCrunch::INPUT_ORDER, gs) == expected,
+                          name + " n=" + std::to_string(c.n) + " gs=" + std::to_string(gs) + " threads=" + std::to_string(threads));
+                }
+            }
+        }
+    }
+
+    /*
+     * Incremental GDV updates against a full recount of the edited graph.
+     */
+    void test_update()
+    {
+        std::mt19937 rng(12);
+        for (unsigned trial = 0; trial < 4; ++trial)
+        {
+            unsigned n = 30 + 20 * trial;
+            auto from = random_graph(n, 0.12, rng);
+            auto to = from;
+            for (unsigned k = 0; k < n / 3; ++k)
+            {
+                unsigned i = rng() % n;
+                unsigned j = rng() % n;
+                if (i != j)
+                {
+                    to[i][j] = to[j][i] = 1 - to[i][j];
+                }
+            }
+
+            auto from_csr = GraphCrunch::to_csr(from);
+            auto to_csr = GraphCrunch::to_csr(to);
+            std::vector<std::pair<int, int>> added;
+            std::vector<std::pair<int, int>> removed;
+            GraphCrunch::edge_changes(from_csr, to_csr, added, removed);
+            for (int gs = 3; gs <= 5; ++gs)
+            {
+                auto gdvs = GraphCrunch::count(from_csr, 1, GraphCrunch::ENUMERATE, GraphCrunch::INPUT_ORDER, gs);
+                auto expected = GraphCrunch::count(to_csr, 1, GraphCrunch::ENUMERATE, GraphCrunch::INPUT_ORDER, gs);
+                check(GraphCrunch::update(from_csr, gdvs, added, removed, gs) == expected,
+                      "update n=" + std::to_string(n) + " gs=" + std::to_string(gs));
+            }
+        }
+    }
+
+    /*
+     * GDV estimates: exact at fraction 1, the same on any number of threads, exact in the
+     * degree and 3 node orbits, and mostly within their 95% confidence intervals elsewhere.
+     */
+    void test_estimate()
+    {
+        std::mt19937 rng(14);
+        auto csr = GraphCrunch::to_csr(random_graph(120, 0.1, rng));
+        for (int gs = 4; gs <= 5; ++gs)
+        {
+            std::string name = " gs=" + std::to_string(gs);
+            auto exact = GraphCrunch::count(csr, 1, GraphCrunch::ENUMERATE, GraphCrunch::INPUT_ORDER, gs);
+
+            GraphCrunch::GdvMatrix margins;
+            check(GraphCrunch::estimate(csr, 1, GraphCrunch::INPUT_ORDER, gs, 1, 7, margins) == exact, "estimate at fraction 1" + name);
+            check(margins == GraphCrunch::GdvMatrix(exact.rows, exact.cols), "margins at fraction 1" + name);
+
+            auto estimated = GraphCrunch::estimate(csr, 1, GraphCrunch::INPUT_ORDER, gs, 0.3, 7, margins);
+            GraphCrunch::GdvMatrix threaded_margins;
+            check(GraphCrunch::estimate(csr, 3, GraphCrunch::INPUT_ORDER, gs, 0.3, 7, threaded_margins) == estimated &&
+                      threaded_margins == margins,
+                  "estimate on 3 threads" + name);
+
+            unsigned covered = 0;
+            unsigned sampled = 0;
+            for (unsigned v = 0; v < exact.rows; ++v)
+            {
+                for (unsigned o = 0; o < exact.cols; ++o)
+                {
+                    double error = std::abs((double)estimated[v][o] - (double)exact[v][o]);
+                    if (o < 4)
+                    {
+                        check(error == 0 && margins[v][o] == 0, "exact orbit " + std::to_string(o) + name);
+                        continue;
+                    }
+                    sampled++;
+                    covered += (error <= margins[v][o]);
+                }
+            }
+            check(covered >= 0.9 * sampled, "estimates within their confidence intervals" + name);
+        }
+    }
+
+    /*
+     * GDVs written to the cache and read back, and the cache misses: another graph, another
+     * graphlet size, and a truncated file.
+     */
+    void test_cache()
+    {
+        auto cache_dir = (std::filesystem::temp_directory_path() / "minaa_test_cache").string();
+        std::filesystem::remove_all(cache_dir);
+
+        std::mt19937 rng(16);
+        auto csr = GraphCrunch::to_csr(random_graph(60, 0.1, rng));
+        auto key = GraphCrunch::fingerprint(csr);
+        for (int gs = 3; gs <= 5; ++gs)
+        {
+            auto cols = GraphCrunch::gdv_length(gs);
+            auto gdvs = GraphCrunch::count(csr, 1, GraphCrunch::ENUMERATE, GraphCrunch::INPUT_ORDER, gs);
+            auto file = FileIO::gdv_cache_path(cache_dir, key, cols);
+            std::string name = " gs=" + std::to_string(gs);
+
+            GraphCrunch::GdvMatrix cached;
+            check(!FileIO::cache_to_gdvs(file, key, csr.V, cols, cached), "cache miss before the write" + name);
+            FileIO::gdvs_to_cache(file, key, gdvs);
+            check(FileIO::cache_to_gdvs(file, key, csr.V, cols, cached) && cached == gdvs, "cache round trip" + name);
+            check(!FileIO::cache_to_gdvs(file, key + 1, csr.V, cols, cached), "cache miss on another key" + name);
+            check(!FileIO::cache_to_gdvs(file, key, csr.V + 1, cols, cached), "cache miss on another size" + name);
+            check(!FileIO::cache_to_gdvs(file, key, csr.V, cols + 1, cached), "cache miss on another length" + name);
+
+            std::filesystem::resize_file(file, std::filesystem::file_size(file) - 8);
+            check(!FileIO::cache_to_gdvs(file, key, csr.V, cols, cached), "cache miss on a truncated file" + name);
+        }
+
+        std::filesystem::remove_all(cache_dir);
+    }
+
+    typedef std::shared_ptr<std::vector<std::vector<double>>> Costs;
+
+    /*
+     * A random rows x cols cost matrix in [0, 1], with few distinct values if ties is set.
+     */
+    Costs random_costs(unsigned rows, unsigned cols, bool ties, std::mt19937 &rng)
+    {
+        std::uniform_real_distribution<double> uniform(0.01, 0.99);
+        auto costs = std::make_shared<std::vector<std::vector<double>>>(rows, std::vector<double>(cols));
+        for (auto &row : *costs)
+        {
+            for (auto &cost : row)
+            {
+                cost = ties ? 0.1 * (1 + rng() % 5) : uniform(rng);
+            }
+        }
+        return costs;
+    }
+
+    /*
+     * The given costs, as calculated on demand by the solvers.
+     */
+    Util::CostProvider provider(Costs costs)
+    {
+        return Util::CostProvider(
+            costs->size(), costs->empty() ? 0 : (*costs)[0].size(),
+            [costs](unsigned begin, unsigned end, double *out)
+            {
+                for (unsigned i = begin; i < end; ++i)
+                {
+                    out = std::copy((*costs)[i].begin(), (*costs)[i].end(), out);
+                }
+            },
+            [costs](unsigned i, unsigned j)
+            { return (*costs)[i][j]; });
+    }
+
+    /*
+     * The total cost of an alignment: the aligned pairs are the nonzero entries.
+     */
+    double total_cost(const std::vector<std::vector<double>> &alignment, const std::vector<std::vector<double>> &costs)
+    {
+        double total = 0;
+        for (unsigned i = 0; i < alignment.size(); ++i)
+        {
+            for (unsigned j = 0; j < alignment[i].size(); ++j)
+            {
+                if (alignment[i][j] != 0)
+                {
+                    total += costs[i][j];
+                }
+            }
+        }
+        return total;
+    }
+
+    /*
+     * The alignment the given solver finds for the costs, from a cold start in double precision.
+     */
+    std::vector<std::vector<double>> solve(Costs costs, Hungarian::Solver solver)
+    {
+        auto costs_provider = provider(costs);
+        Util::WarmStart warm;
+        return Hungarian::hungarian(costs_provider, Util::DOUBLE_COSTS, solver, 1, warm);
+    }
+
+    /*
+     * The total cost of an alignment in 16-bit fixed point, as the auction solvers see the costs.
+     */
+    unsigned long long fixed16_cost(const std::vector<std::vector<double>> &alignment, const std::vector<std::vector<double>> &costs)
+    {
+        unsigned long long total = 0;
+        for (unsigned i = 0; i < alignment.size(); ++i)
+        {
+            for (unsigned j = 0; j < alignment[i].size(); ++j)
+            {
+                if (alignment[i][j] != 0)
+                {
+                    total += Util::to_cost<Util::Fixed16>(costs[i][j]);
+                }
+            }
+        }
+        return total;
+    }
+
+    /*
+     * The Jonker-Volgenant solver against Munkres on the total cost, square and rectangular.
+     */
+    void test_jonker_volgenant()
+    {
+        std::mt19937 rng(13);
+        for (unsigned trial = 0; trial < 30; ++trial)
+        {
+            unsigned rows = 1 + rng() % 25;
+            unsigned cols = (trial % 3 == 0) ? rows : 1 + rng() % 25;
+            auto costs = random_costs(rows, cols, trial % 2 == 1, rng);
+            double munkres = total_cost(solve(costs, Hungarian::MUNKRES), *costs);
+            double jv = total_cost(solve(costs, Hungarian::JONKER_VOLGENANT), *costs);
+            check(std::abs(munkres - jv) < 1e-9, "jv " + std::to_string(rows) + "x" + std::to_string(cols));
+        }
+    }
+
+    /*
+     * The sparse Jonker-Volgenant solver against the dense one on the total cost: with every pair
+     * a candidate, and with a few candidates per row costing under 1 / rows each, so that the
+     * dense solver, which gives the other pairs cost 1, keeps to the candidates too.
+     */
+    void test_sparse_jonker_volgenant()
+    {
+        std::mt19937 rng(15);
+        for (unsigned trial = 0; trial < 30; ++trial)
+        {
+            bool every_pair = (trial % 2 == 0);
+            unsigned rows = 1 + rng() % 25;
+            unsigned cols = every_pair ? 1 + rng() % 25 : rows + rng() % 5;
+            auto costs = random_costs(rows, cols, trial % 4 < 2, rng);
+
+            Util::SparseCostMatrix sparse;
+            sparse.rows = rows;
+            sparse.cols = cols;
+            for (unsigned i = 0; i < rows; ++i)
+            {
+                for (unsigned j = 0; j < cols; ++j)
+                {
+                    // Node i of H is always a candidate, so that there is a complete alignment
+                    if (every_pair || j == i || rng() % 4 == 0)
+                    {
+                        if (!every_pair)
+                        {
+                            (*costs)[i][j] /= rows;
+                        }
+                        sparse.indices.push_back(j);
+                        sparse.values.push_back((*costs)[i][j]);
+                    }
+                    else
+                    {
+                        (*costs)[i][j] = 1;
+                    }
+                }
+                sparse.offsets.push_back(sparse.indices.size());
+            }
+
+            double dense = total_cost(solve(costs, Hungarian::JONKER_VOLGENANT), *costs);
+            double candidates = total_cost(Hungarian::hungarian(sparse), *costs);
+            check(std::abs(dense - candidates) < 1e-9, std::string(every_pair ? "sparse jv " : "sparse jv candidates ") +
+                                                            std::to_string(rows) + "x" + std::to_string(cols));
+        }
+    }
+
+    /*
+     * The exact auction against Jonker-Volgenant in 16-bit fixed point, which both find the
+     * optimum of, on 1 and 3 threads, square and rectangular.
+     */
+    void test_auction()
+    {
+        std::mt19937 rng(17);
+        for (unsigned trial = 0; trial < 30; ++trial)
+        {
+            unsigned rows = 1 + rng() % 40;
+            unsigned cols = (trial % 3 == 0) ? rows : 1 + rng() % 40;
+            auto costs = random_costs(rows, cols, trial % 2 == 1, rng);
+
+            auto jv_provider = provider(costs);
+            Util::WarmStart warm;
+            auto jv = fixed16_cost(Hungarian::hungarian(jv_provider, Util::FIXED16_COSTS, Hungarian::JONKER_VOLGENANT, 1, warm), *costs);
+            for (unsigned threads : {1u, 3u})
+            {
+                auto auction_provider = provider(costs);
+                auto auction = fixed16_cost(Hungarian::auction(auction_provider, true, threads), *costs);
+                check(auction == jv, "auction " + std::to_string(rows) + "x" + std::to_string(cols) + " threads=" + std::to_string(threads));
+            }
+        }
+    }
+
+    /*
+     * Warm started Jonker-Volgenant solves against cold ones on the total cost, along a sweep
+     * of costs that drift from one solve to the next, as over a sweep of alpha. The state is
+     * carried through a warm start file, and a state for another size is ignored.
+     */
+    void test_warm_start()
+    {
+        auto warm_file = (std::filesystem::temp_directory_path() / "minaa_test_warm").string();
+
+        std::mt19937 rng(18);
+        for (unsigned trial = 0; trial < 12; ++trial)
+        {
+            unsigned rows = 1 + rng() % 30;
+            unsigned cols = (trial % 3 == 0) ? rows : 1 + rng() % 30;
+            auto start = random_costs(rows, cols, trial % 2 == 1, rng);
+            auto end = random_costs(rows, cols, trial % 2 == 1, rng);
+            std::filesystem::remove(warm_file);
+
+            for (unsigned step = 0; step <= 4; ++step)
+            {
+                auto costs = std::make_shared<std::vector<std::vector<double>>>(*start);
+                for (unsigned i = 0; i < rows; ++i)
+                {
+                    for (unsigned j = 0; j < cols; ++j)
+                    {
+                        (*costs)[i][j] += step * ((*end)[i][j] - (*start)[i][j]) / 4;
+                    }
+                }
+
+                Util::WarmStart warm;
+                check(FileIO::file_to_warm_start(warm_file, rows, cols, warm) == (step > 0), "warm start file read");
+                auto warm_provider = provider(costs);
+                auto warm_alignment = Hungarian::hungarian(warm_provider, Util::DOUBLE_COSTS, Hungarian::JONKER_VOLGENANT, 1, warm);
+                FileIO::warm_start_to_file(warm_file, warm);
+
+                double cold = total_cost(solve(costs, Hungarian::JONKER_VOLGENANT), *costs);
+                check(std::abs(total_cost(warm_alignment, *costs) - cold) < 1e-9,
+                      "warm start " + std::to_string(rows) + "x" + std::to_string(cols) + " step=" + std::to_string(step));
+            }
+
+            // A state for other costs of another size
+            auto other = random_costs(rows + 1, cols, false, rng);
+            Util::WarmStart warm;
+            check(!FileIO::file_to_warm_start(warm_file, rows + 1, cols, warm), "warm start file for another size");
+            FileIO::file_to_warm_start(warm_file, rows, cols, warm);
+            auto other_provider = provider(other);
+            double stale = total_cost(Hungarian::hungarian(other_provider, Util::DOUBLE_COSTS, Hungarian::JONKER_VOLGENANT, 1, warm), *other);
+            check(std::abs(stale - total_cost(solve(other, Hungarian::JONKER_VOLGENANT), *other)) < 1e-9, "warm start state for another size");
+        }
+
+        std::filesystem::remove(warm_file);
+    }
+}
+
+int main()
+{
+    test_engine(GraphCrunch::ENUMERATE, "enum");
+    test_engine(GraphCrunch::ESU, "esu");
+    test_engine(GraphCrunch::EQUATIONS, "orca");
+    test_update();
+    test_estimate();
+    test_cache();
+    test_jonker_volgenant();
+    test_sparse_jonker_volgenant();
+    test_auction();
+    test_warm_start();
+    std::cout << "\33[2K\r"; // PROGRESS
+
+    if (failures > 0)
+    {
+        std::cout << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}